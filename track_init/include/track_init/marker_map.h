@@ -0,0 +1,19 @@
+#pragma once
+#include <opencv2/opencv.hpp>
+
+#include <vector>
+#include <string>
+
+namespace track {
+
+// dark planar quadrilateral of the map, corners in order around it (mm, world frame)
+struct Marker {
+  std::vector<cv::Point3d> corners;
+};
+
+// markers of a map file of the tracker, one segment "x1 y1 z1 x2 y2 z2" per
+// line: every closed chain of 4 segments is a marker, other segments are
+// ignored. False if the file cannot be read.
+bool loadMarkers(const std::string& path, std::vector<Marker>& markers);
+
+} // namespace
@@ -7,9 +7,13 @@
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <dvs_msgs/Event.h>
+#include <dvs_msgs/EventArray.h>
 
 #include <opencv2/opencv.hpp>
 
+#include "marker_map.h"
+
 #include <vector>
 #include <algorithm>
 #include <string>
@@ -18,9 +22,21 @@ namespace track {
 
 class TrackInit {
 public:
-  TrackInit(ros::NodeHandle & nh);
+  // topics on nh and parameters on the private pnh
+  TrackInit(ros::NodeHandle & nh, ros::NodeHandle & pnh);
   virtual ~TrackInit();
 
+  // margin around the markers in view searched first, in sizes of their box
+  const double ROI_MARGIN = 0.5;
+  // smallest marker, fraction of the image area
+  const double MIN_SQUARE_AREA = 0.01;
+  // largest distance between a reprojected marker corner and a detected
+  // one, fraction of the size of the detected quadrilateral
+  const double MATCH_DISTANCE = 0.15;
+  // poses of different markers explaining as many quadrilaterals are told
+  // apart by the last pose when one camera is this many times nearer to it
+  const double TIE_DISTANCE_RATIO = 2;
+
 private:
   ros::NodeHandle nh_;
 
@@ -28,14 +44,71 @@ private:
   void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg);
   // handle raw grayscale intensity image
   void imageCallback(const sensor_msgs::Image::ConstPtr& msg);
-  // find square in image an return points
-  static std::vector<cv::Point> findSquare(const cv_bridge::CvImage img);
+  // accumulate events in event windows
+  void eventsCallback(const dvs_msgs::EventArray::ConstPtr& msg);
+  // find the markers in the event image of a window and publish the pose
+  void processEventImage(const ros::Time& stamp);
+  // rebuild the undistortion maps for images of size if needed
+  void updateUndistortMaps(const cv::Size& size);
+  // find the markers in an undistorted image, dark or as the edges of an
+  // event image, around the markers of the last pose first, publish the
+  // pose with stamp and draw it in rendering
+  void detectMarkers(const cv::Mat& img, bool edges, const ros::Time& stamp, cv_bridge::CvImage& rendering);
+  // pose of the map explaining the most quadrilaterals: every quadrilateral
+  // and marker pair gives a pose, the best one is refined with the corners
+  // of all the markers it matches. False if none, or if other markers
+  // explain as many quadrilaterals (identical markers) and the last pose
+  // does not tell them apart.
+  bool estimatePose(const std::vector<std::vector<cv::Point> >& quads, cv::Mat& rotation_vector,
+                    cv::Mat& translation_vector);
+  // markers of the map matching a quadrilateral once projected with a pose:
+  // their corners and the matching image points, their indices in
+  // increasing order, count returned
+  int matchMarkers(const std::vector<std::vector<cv::Point> >& quads, const std::vector<double>& sizes,
+                   const cv::Mat& rotation_vector, const cv::Mat& translation_vector,
+                   std::vector<cv::Point3d>* model_points, std::vector<cv::Point2d>* image_points,
+                   std::vector<int>* matched) const;
+  // publish the camera pose of a map pose (opencv convention)
+  void publishPose(const cv::Mat& rotation_vector, const cv::Mat& translation_vector, const ros::Time& stamp);
+  // find the quadrilaterals in the region roi of an image, corners sorted
+  // CW, in image coordinates, by decreasing area. Contours smaller than
+  // min_area pixels are skipped, and when roi is not the whole image, those
+  // touching its border. Contours are tested in parallel. The edges of an
+  // event image are bands, their quadrilateral is the center line.
+  static std::vector<std::vector<cv::Point> > findQuadrilaterals(const cv::Mat& img, const cv::Rect& roi,
+                                                                 double min_area, bool edges);
   // sort points CW
   static void sortPointsCW(std::vector<cv::Point> &points);
 
+  // planar markers of the map, from map_file or the default map of the tracker
+  std::vector<Marker> markers_;
+
   bool got_camera_info_;
   cv::Mat camera_matrix_, dist_coeffs_;
   ros::Subscriber camera_info_sub_;
+  // undistortion maps of the calibration, built for the image size at the
+  // first image after the calibration changes
+  cv::Mat undistort_map1_, undistort_map2_;
+  cv::Size undistort_size_;
+  bool undistort_maps_valid_;
+  // undistorted image, reused
+  cv::Mat undistorted_;
+
+  // region around the markers in view at the last pose, searched before the whole image
+  bool has_roi_;
+  cv::Rect roi_;
+  // camera position of the last pose, breaks ties between markers while has_roi_
+  cv::Point3d last_position_;
+
+  // EVENT INIT
+  // the square is found in images of the events of event_window_ seconds
+  // instead of intensity frames, when event_init_
+  bool event_init_;
+  double event_window_;
+  ros::Subscriber event_sub_;
+  // 255 at the pixels with events in the current window
+  cv::Mat event_image_;
+  ros::Time event_window_start_;
 
   image_transport::Publisher image_pub_;
   image_transport::Subscriber image_sub_;
@@ -0,0 +1,75 @@
+#include "track_init/marker_map.h"
+#include <ros/ros.h>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+namespace track {
+
+namespace {
+
+struct Segment {
+  cv::Point3d p1, p2;
+};
+
+// same point of the map file, up to its printed precision
+bool samePoint(const cv::Point3d& a, const cv::Point3d& b) {
+  return std::abs(a.x - b.x) < 1e-3 and std::abs(a.y - b.y) < 1e-3 and std::abs(a.z - b.z) < 1e-3;
+}
+
+} // namespace
+
+bool loadMarkers(const std::string& path, std::vector<Marker>& markers) {
+  std::ifstream file(path);
+  if (!file.is_open()) {
+    ROS_ERROR_STREAM("cannot open map file " << path);
+    return false;
+  }
+  std::vector<Segment> segments;
+  std::string line;
+  int line_number = 0;
+  while (std::getline(file, line)) {
+    ++line_number;
+    std::size_t start = line.find_first_not_of(" \t");
+    if (start == std::string::npos or line[start] == '#') continue;
+    std::istringstream ss(line);
+    Segment s;
+    if (!(ss >> s.p1.x >> s.p1.y >> s.p1.z >> s.p2.x >> s.p2.y >> s.p2.z)) {
+      ROS_ERROR_STREAM("bad segment in " << path << ':' << line_number);
+      return false;
+    }
+    segments.push_back(s);
+  }
+
+  // chain segments end to end, in either direction, back to the start in 4
+  markers.clear();
+  std::vector<bool> used(segments.size(), false);
+  for (size_t i = 0; i < segments.size(); ++i) {
+    if (used[i]) continue;
+    std::vector<size_t> chain { i };
+    Marker marker;
+    marker.corners.push_back(segments[i].p1);
+    cv::Point3d end = segments[i].p2;
+    while (chain.size() < 4) {
+      size_t next = segments.size();
+      for (size_t j = 0; j < segments.size() and next == segments.size(); ++j) {
+        if (used[j] or std::find(chain.begin(), chain.end(), j) != chain.end()) continue;
+        if (samePoint(segments[j].p1, end) or samePoint(segments[j].p2, end)) next = j;
+      }
+      if (next == segments.size()) break;
+      marker.corners.push_back(end);
+      end = samePoint(segments[next].p1, end) ? segments[next].p2 : segments[next].p1;
+      chain.push_back(next);
+    }
+    if (chain.size() == 4 and samePoint(end, marker.corners[0])) {
+      for (size_t j : chain) used[j] = true;
+      markers.push_back(marker);
+    }
+  }
+  ROS_INFO_STREAM("loaded " << markers.size() << " markers from " << segments.size() <<
+    " segments of " << path);
+  return true;
+}
+
+} // namespace
@@ -1,14 +1,65 @@
 #include "track_init/track_init.h"
+#include <ros/package.h>
 
 namespace track {
-TrackInit::TrackInit(ros::NodeHandle & nh) : nh_(nh) {
+
+namespace {
+
+// cv::parallel_for_ body of a lambda, taken directly only since OpenCV 3.3
+template<class F>
+class ParallelBody : public cv::ParallelLoopBody {
+public:
+  explicit ParallelBody(const F& f) : f_(f) {}
+  void operator()(const cv::Range& range) const override { f_(range); }
+private:
+  const F& f_;
+};
+
+// f(range) on chunks of [0, n) in the OpenCV threads
+template<class F>
+void parallelFor(size_t n, const F& f) {
+  cv::parallel_for_(cv::Range(0, int(n)), ParallelBody<F>(f));
+}
+
+// every corner of the marker in front of the camera of the map pose R, t
+bool inFront(const Marker& marker, const cv::Mat& R, const cv::Mat& t) {
+  for (const cv::Point3d& p : marker.corners) {
+    double z = R.at<double>(2, 0)*p.x + R.at<double>(2, 1)*p.y + R.at<double>(2, 2)*p.z + t.at<double>(2);
+    if (z <= 0) return false;
+  }
+  return true;
+}
+
+// camera position in the map of the map pose of opencv
+cv::Point3d cameraPosition(const cv::Mat& rotation_vector, const cv::Mat& translation_vector) {
+  cv::Mat R;
+  cv::Rodrigues(rotation_vector, R);
+  return cv::Point3d(cv::Mat(-R.t()*translation_vector));
+}
+
+} // namespace
+
+TrackInit::TrackInit(ros::NodeHandle & nh, ros::NodeHandle & pnh) : nh_(nh) {
   got_camera_info_ = false;
+  undistort_maps_valid_ = false;
+  has_roi_ = false;
+  // pose from event images instead of intensity frames
+  pnh.param("event_init", event_init_, false);
+  pnh.param("event_window", event_window_, 0.01);
+  // markers of the map file of the tracker, its 85mm square by default
+  std::string map_file;
+  pnh.param("map_file", map_file, ros::package::getPath("tracker") + "/maps/square.map");
+  if (loadMarkers(map_file, markers_) and markers_.empty())
+    ROS_ERROR_STREAM("no marker (closed chain of 4 segments) in " << map_file);
 
   // setup subscribers and publishers
   camera_info_sub_ = nh_.subscribe("camera_info", 1, &TrackInit::cameraInfoCallback, this);
 
   image_transport::ImageTransport it_(nh_);
-  image_sub_ = it_.subscribe("image", 1, &TrackInit::imageCallback, this);
+  if (event_init_)
+    event_sub_ = nh_.subscribe("events", 10, &TrackInit::eventsCallback, this);
+  else
+    image_sub_ = it_.subscribe("image", 1, &TrackInit::imageCallback, this);
   image_pub_ = it_.advertise("rendering", 1);
   poseStampedPub = nh_.advertise<geometry_msgs::PoseStamped>("pose", 2, true);
 }
@@ -19,6 +70,16 @@ TrackInit::~TrackInit() {
 }
 
 void TrackInit::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg) {
+  // camera info comes with every image, the maps are only rebuilt on a change
+  if (got_camera_info_ and msg->D.size() == dist_coeffs_.total()) {
+    bool same = true;
+    for (int i = 0; i < 3; i++)
+      for (int j = 0; j < 3; j++)
+        same = same and camera_matrix_.at<double>(cv::Point(i, j)) == msg->K[i+j*3];
+    for (int i = 0; i < msg->D.size(); i++)
+      same = same and dist_coeffs_.at<double>(i) == msg->D[i];
+    if (same) return;
+  }
   ROS_DEBUG("got camera info");
   got_camera_info_ = true;
 
@@ -30,6 +91,7 @@ void TrackInit::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg)
   dist_coeffs_ = cv::Mat(msg->D.size(), 1, CV_64F);
   for (int i = 0; i < msg->D.size(); i++)
     dist_coeffs_.at<double>(i) = msg->D[i];
+  undistort_maps_valid_ = false;
 }
 
 void TrackInit::imageCallback(const sensor_msgs::Image::ConstPtr& msg) {
@@ -43,108 +105,299 @@ void TrackInit::imageCallback(const sensor_msgs::Image::ConstPtr& msg) {
   }
 
   ROS_DEBUG("got an image");
-  // undistort image
+  if (!got_camera_info_) return;
+  // undistort image with maps computed once per calibration, unlike
+  // cv::undistort that builds them for every image
+  const cv::Mat& image = cv_ptr->image;
+  updateUndistortMaps(cv::Size(image.cols, image.rows));
+  cv::remap(image, undistorted_, undistort_map1_, undistort_map2_, cv::INTER_LINEAR);
   cv_bridge::CvImage cv_img;
   cv_img.encoding = cv_ptr->encoding;
-  cv::undistort(cv_ptr->image, cv_img.image, camera_matrix_, dist_coeffs_);
-
-  // find square in image
-  std::vector<cv::Point> square = findSquare(cv_img);
-
-  // draw square and publish
-  if (square.size() > 0) {
-  
-    ROS_DEBUG_STREAM("got a square: " <<  square);
-    // grayscale to color
-    cv::cvtColor(cv_img.image, cv_img.image, CV_GRAY2BGR);
-    cv_img.encoding = "bgr8";
-    // add square
-    cv::polylines(cv_img.image, square, true, cv::Scalar(0,0,255), 3, cv::LINE_AA);
-
-    // TEMPORAL code here to get camera position
-    // assuming square to be 85x85mm centered in Z = 0 plane
-    // that is corners are at [+-85/2, +-85/2, 0]
-
-    // sort point clockwise
-    sortPointsCW(square);
-    ROS_DEBUG_STREAM("sorted points:" << square);
-
-    for (int i = 0; i < 4; ++i) {
-        cv::Point &p = square[i];
-        cv::circle(cv_img.image, p, 1, CV_RGB(0,0,255),5);
-        cv::putText(cv_img.image, std::to_string(i+1), p, cv::FONT_HERSHEY_DUPLEX, 1, cv::Scalar(0,143,143), 2);
-    }
+  cv_img.image = undistorted_;
+
+  detectMarkers(undistorted_, false, msg->header.stamp, cv_img);
+
+  image_pub_.publish(cv_img.toImageMsg());
+}
 
-    float hw = 85.0f/2; // half width of square
-    // now estimate camera position
-    std::vector<cv::Point3d> model_points {
-      cv::Point3f(-hw, -hw, 0.0f),
-      cv::Point3f( hw, -hw, 0.0f),
-      cv::Point3f( hw,  hw, 0.0f),
-      cv::Point3f(-hw,  hw, 0.0f)
-    };
-
-    std::vector<cv::Point2d> image_points;
-    cv::Mat(square).convertTo(image_points, cv::Mat(image_points).type());  
-
-    cv::Mat rotation_vector; // Rotation in axis-angle form
-    cv::Mat translation_vector;
-    cv::solvePnP(model_points, image_points, camera_matrix_, dist_coeffs_,
-      rotation_vector, translation_vector, false, cv::SOLVEPNP_ITERATIVE);
-
-    ROS_DEBUG_STREAM("model points" << cv::Mat(model_points) << "\nimage points:" << cv::Mat(image_points));
-    ROS_DEBUG_STREAM("Rotation Vector\n" << rotation_vector);
-    ROS_DEBUG_STREAM("Translation Vector\n" << translation_vector);
-    
-    // reproject points
-    std::vector<cv::Point2d> proj_image_points;
-    cv::projectPoints(model_points, rotation_vector, translation_vector, camera_matrix_, dist_coeffs_, proj_image_points);
-    ROS_INFO_STREAM("Points reprojected");
-    for (int i = 0; i < 4; ++i) {
-        cv::Point2d &p = proj_image_points[i];
-        ROS_INFO_STREAM("P" << i << ": " << p);
-        cv::circle(cv_img.image, p, 1, CV_RGB(0,255,0),3);
+void TrackInit::eventsCallback(const dvs_msgs::EventArray::ConstPtr& msg) {
+  if (!got_camera_info_ or msg->events.empty()) return;
+  if (event_image_.rows != int(msg->height) or event_image_.cols != int(msg->width)) {
+    event_image_ = cv::Mat::zeros(msg->height, msg->width, CV_8U);
+    event_window_start_ = msg->events.front().ts;
+  }
+  for (const dvs_msgs::Event& e : msg->events) {
+    // a new window when full or when time goes back (replayed bag)
+    if (e.ts < event_window_start_) {
+      event_image_.setTo(0);
+      event_window_start_ = e.ts;
+    } else if ((e.ts - event_window_start_).toSec() >= event_window_) {
+      // stamped in the middle of the window
+      processEventImage(event_window_start_ + ros::Duration((e.ts - event_window_start_).toSec()/2));
+      event_image_.setTo(0);
+      event_window_start_ = e.ts;
     }
+    event_image_.at<uchar>(e.y, e.x) = 255;
+  }
+}
+
+void TrackInit::processEventImage(const ros::Time& stamp) {
+  ROS_DEBUG("got an event image");
+  updateUndistortMaps(cv::Size(event_image_.cols, event_image_.rows));
+  // nearest: the event image is binary
+  cv::remap(event_image_, undistorted_, undistort_map1_, undistort_map2_, cv::INTER_NEAREST);
+  cv_bridge::CvImage cv_img;
+  cv_img.encoding = sensor_msgs::image_encodings::MONO8;
+  cv_img.image = undistorted_;
 
+  detectMarkers(undistorted_, true, stamp, cv_img);
 
-    // OPENCV assumes frameCoordinates = R * worldCoordinates + t 
-    // camera position = - R' * t
-    // camera orientation = R'
-    cv::Mat R;
-    cv::Rodrigues(rotation_vector, R);
-    R = R.t();
-    translation_vector = -R * translation_vector;
-    cv::Rodrigues(R, rotation_vector);
+  image_pub_.publish(cv_img.toImageMsg());
+}
 
-    cv::Point3d pos(translation_vector);
-    cv::Point3d rot(rotation_vector);
+void TrackInit::updateUndistortMaps(const cv::Size& size) {
+  if (undistort_maps_valid_ and size.width == undistort_size_.width and size.height == undistort_size_.height)
+    return;
+  undistort_size_ = size;
+  cv::initUndistortRectifyMap(camera_matrix_, dist_coeffs_, cv::Mat(), camera_matrix_,
+    undistort_size_, CV_16SC2, undistort_map1_, undistort_map2_);
+  undistort_maps_valid_ = true;
+  has_roi_ = false;
+}
 
-    geometry_msgs::PoseStamped poseStamped;
+void TrackInit::detectMarkers(const cv::Mat& img, bool edges, const ros::Time& stamp, cv_bridge::CvImage& rendering) {
+  cv::Rect frame(0, 0, img.cols, img.rows);
+  double min_area = MIN_SQUARE_AREA*img.total();
+  // markers around the last pose, then in the whole image
+  std::vector<std::vector<cv::Point> > quads;
+  cv::Mat rotation_vector; // Rotation in axis-angle form
+  cv::Mat translation_vector;
+  bool found = false;
+  if (has_roi_) {
+    quads = findQuadrilaterals(img, roi_, min_area, edges);
+    found = estimatePose(quads, rotation_vector, translation_vector);
+  }
+  if (!found) {
+    quads = findQuadrilaterals(img, frame, min_area, edges);
+    found = estimatePose(quads, rotation_vector, translation_vector);
+  }
+  has_roi_ = false;
+  if (!found) return;
+
+  // grayscale to color, in a new image: undistorted_ is reused
+  cv::cvtColor(img, rendering.image, CV_GRAY2BGR);
+  rendering.encoding = "bgr8";
+  // add quadrilaterals
+  for (const std::vector<cv::Point>& quad : quads)
+    cv::polylines(rendering.image, quad, true, cv::Scalar(0,0,255), 3, cv::LINE_AA);
+
+  // reproject the markers in view, their box is the next region
+  cv::Mat R;
+  cv::Rodrigues(rotation_vector, R);
+  std::vector<cv::Point2d> proj_image_points;
+  for (const Marker& marker : markers_) {
+    if (!inFront(marker, R, translation_vector)) continue;
+    cv::projectPoints(marker.corners, rotation_vector, translation_vector, camera_matrix_, cv::Mat(), proj_image_points);
+    double x0 = proj_image_points[0].x, x1 = x0, y0 = proj_image_points[0].y, y1 = y0;
+    for (const cv::Point2d& p : proj_image_points) {
+      cv::circle(rendering.image, p, 1, CV_RGB(0,255,0),3);
+      x0 = std::min(x0, p.x); x1 = std::max(x1, p.x);
+      y0 = std::min(y0, p.y); y1 = std::max(y1, p.y);
+    }
+    cv::Rect box = cv::Rect(int(x0), int(y0), int(x1 - x0) + 1, int(y1 - y0) + 1) & frame;
+    if (box.area() == 0) continue;
+    int margin = int(ROI_MARGIN*std::max(box.width, box.height));
+    box = cv::Rect(box.x - margin, box.y - margin, box.width + 2*margin, box.height + 2*margin) & frame;
+    roi_ = has_roi_ ? (roi_ | box) : box;
+    has_roi_ = true;
+  }
 
-    poseStamped.header.frame_id="map";
-    poseStamped.header.stamp = ros::Time::now();
+  last_position_ = cameraPosition(rotation_vector, translation_vector);
+  publishPose(rotation_vector, translation_vector, stamp);
+}
 
-    poseStamped.pose.position.x = pos.x;
-    poseStamped.pose.position.y = pos.y;
-    poseStamped.pose.position.z = pos.z;
+bool TrackInit::estimatePose(const std::vector<std::vector<cv::Point> >& quads, cv::Mat& rotation_vector,
+                             cv::Mat& translation_vector) {
+  if (quads.empty() or markers_.empty()) return false;
+  // size of each quadrilateral, for the match distances
+  std::vector<double> sizes(quads.size());
+  for (size_t i = 0; i < quads.size(); ++i)
+    sizes[i] = std::sqrt(cv::contourArea(quads[i]));
+
+  // one pose per quadrilateral and marker pair, in parallel: the one of the
+  // 4 rotations and 2 directions of the marker corners on the quadrilateral
+  // explaining the most quadrilaterals, the first on a tie
+  struct Hypothesis {
+    int matches = 0;
+    cv::Mat rotation_vector, translation_vector;
+  };
+  std::vector<Hypothesis> hypotheses(quads.size()*markers_.size());
+  parallelFor(hypotheses.size(), [&](const cv::Range& range) {
+    std::vector<cv::Point2d> image_points(4);
+    for (int h = range.start; h < range.end; ++h) {
+      const std::vector<cv::Point>& quad = quads[h / markers_.size()];
+      const Marker& marker = markers_[h % markers_.size()];
+      for (int k = 0; k < 8; ++k) {
+        for (int i = 0; i < 4; ++i) {
+          const cv::Point& p = quad[k < 4 ? (i + k) % 4 : (k - i) % 4];
+          image_points[i] = cv::Point2d(p.x, p.y);
+        }
+        cv::Mat r, t;
+        cv::solvePnP(marker.corners, image_points, camera_matrix_, cv::Mat(), r, t, false, cv::SOLVEPNP_ITERATIVE);
+        int matches = matchMarkers(quads, sizes, r, t, nullptr, nullptr, nullptr);
+        if (matches > hypotheses[h].matches) {
+          hypotheses[h].matches = matches;
+          hypotheses[h].rotation_vector = r;
+          hypotheses[h].translation_vector = t;
+        }
+      }
+    }
+  });
+  int best_matches = 0;
+  for (const Hypothesis& hypothesis : hypotheses)
+    best_matches = std::max(best_matches, hypothesis.matches);
+  if (best_matches == 0) return false;
+
+  // with identical markers, other markers explain the quadrilaterals as
+  // well: one candidate per set of matched markers, the first one, on the
+  // largest quadrilateral
+  std::vector<size_t> candidates;
+  std::vector<std::vector<int> > matched_sets;
+  for (size_t h = 0; h < hypotheses.size(); ++h) {
+    if (hypotheses[h].matches < best_matches) continue;
+    std::vector<int> matched;
+    matchMarkers(quads, sizes, hypotheses[h].rotation_vector, hypotheses[h].translation_vector,
+      nullptr, nullptr, &matched);
+    if (std::find(matched_sets.begin(), matched_sets.end(), matched) != matched_sets.end()) continue;
+    matched_sets.push_back(matched);
+    candidates.push_back(h);
+  }
+  size_t best = candidates[0];
+  if (candidates.size() > 1) {
+    // only the last pose can tell them apart, if one camera is clearly nearer
+    if (!has_roi_) {
+      ROS_WARN_STREAM_THROTTLE(1, candidates.size() << " sets of markers explain the quadrilaterals, no pose");
+      return false;
+    }
+    std::vector<double> distances;
+    for (size_t h : candidates)
+      distances.push_back(cv::norm(cameraPosition(hypotheses[h].rotation_vector,
+                                                  hypotheses[h].translation_vector) - last_position_));
+    size_t nearest = std::min_element(distances.begin(), distances.end()) - distances.begin();
+    for (size_t i = 0; i < distances.size(); ++i) {
+      if (i != nearest and distances[i] < TIE_DISTANCE_RATIO*distances[nearest]) {
+        ROS_WARN_STREAM_THROTTLE(1, candidates.size() << " sets of markers explain the quadrilaterals"
+          " as well near the last pose, no pose");
+        return false;
+      }
+    }
+    best = candidates[nearest];
+  }
 
-    double angle = sqrt(rot.x*rot.x + rot.y*rot.y + rot.z*rot.z);
+  // a single PnP with the corners of all the markers matched
+  std::vector<cv::Point3d> model_points;
+  std::vector<cv::Point2d> image_points;
+  matchMarkers(quads, sizes, hypotheses[best].rotation_vector, hypotheses[best].translation_vector,
+    &model_points, &image_points, nullptr);
+  rotation_vector = hypotheses[best].rotation_vector;
+  translation_vector = hypotheses[best].translation_vector;
+  // the points are undistorted already
+  cv::solvePnP(model_points, image_points, camera_matrix_, cv::Mat(),
+    rotation_vector, translation_vector, true, cv::SOLVEPNP_ITERATIVE);
+
+  ROS_DEBUG_STREAM(hypotheses[best].matches << " markers matched in " << quads.size() << " quadrilaterals");
+  ROS_DEBUG_STREAM("model points" << cv::Mat(model_points) << "\nimage points:" << cv::Mat(image_points));
+  ROS_DEBUG_STREAM("Rotation Vector\n" << rotation_vector);
+  ROS_DEBUG_STREAM("Translation Vector\n" << translation_vector);
+  return true;
+}
 
-    if (angle > 0.0) {
-        poseStamped.pose.orientation.x = rot.x * sin(angle/2)/angle;
-        poseStamped.pose.orientation.y = rot.y * sin(angle/2)/angle;
-        poseStamped.pose.orientation.z = rot.z * sin(angle/2)/angle;
-        poseStamped.pose.orientation.w = cos(angle/2);
-    } else {
-        poseStamped.pose.orientation.x = 0;
-        poseStamped.pose.orientation.y = 0;
-        poseStamped.pose.orientation.z = 0;
-        poseStamped.pose.orientation.w = 1;
+int TrackInit::matchMarkers(const std::vector<std::vector<cv::Point> >& quads, const std::vector<double>& sizes,
+                            const cv::Mat& rotation_vector, const cv::Mat& translation_vector,
+                            std::vector<cv::Point3d>* model_points, std::vector<cv::Point2d>* image_points,
+                            std::vector<int>* matched) const {
+  cv::Mat R;
+  cv::Rodrigues(rotation_vector, R);
+  std::vector<bool> used(quads.size(), false);
+  if (matched) matched->clear();
+  std::vector<cv::Point2d> projected;
+  int matches = 0;
+  for (size_t m = 0; m < markers_.size(); ++m) {
+    const Marker& marker = markers_[m];
+    if (!inFront(marker, R, translation_vector)) continue;
+    cv::projectPoints(marker.corners, rotation_vector, translation_vector, camera_matrix_, cv::Mat(), projected);
+    for (size_t q = 0; q < quads.size(); ++q) {
+      if (used[q]) continue;
+      // every projected corner close to a distinct corner of the quadrilateral
+      int corners[4];
+      bool match = true;
+      for (int i = 0; i < 4 and match; ++i) {
+        double nearest = MATCH_DISTANCE*sizes[q];
+        corners[i] = -1;
+        for (int j = 0; j < 4; ++j) {
+          double dx = quads[q][j].x - projected[i].x, dy = quads[q][j].y - projected[i].y;
+          double distance = std::sqrt(dx*dx + dy*dy);
+          if (distance < nearest) {
+            nearest = distance;
+            corners[i] = j;
+          }
+        }
+        match = corners[i] >= 0 and std::find(corners, corners + i, corners[i]) == corners + i;
+      }
+      if (!match) continue;
+      used[q] = true;
+      if (matched) matched->push_back(int(m));
+      ++matches;
+      if (model_points) {
+        for (int i = 0; i < 4; ++i) {
+          model_points->push_back(marker.corners[i]);
+          image_points->push_back(cv::Point2d(quads[q][corners[i]].x, quads[q][corners[i]].y));
+        }
+      }
+      break;
     }
-    poseStampedPub.publish(poseStamped); 
   }
+  return matches;
+}
 
-  image_pub_.publish(cv_img.toImageMsg());
+void TrackInit::publishPose(const cv::Mat& rotation_vector, const cv::Mat& translation_vector, const ros::Time& stamp) {
+  // OPENCV assumes frameCoordinates = R * worldCoordinates + t 
+  // camera position = - R' * t
+  // camera orientation = R'
+  cv::Mat R;
+  cv::Rodrigues(rotation_vector, R);
+  R = R.t();
+  cv::Mat position = -R * translation_vector;
+  cv::Mat orientation;
+  cv::Rodrigues(R, orientation);
+
+  cv::Point3d pos(position);
+  cv::Point3d rot(orientation);
+
+  geometry_msgs::PoseStamped poseStamped;
+
+  poseStamped.header.frame_id="map";
+  // time of the image or events, the tracker replays the events from it
+  poseStamped.header.stamp = stamp;
+
+  poseStamped.pose.position.x = pos.x;
+  poseStamped.pose.position.y = pos.y;
+  poseStamped.pose.position.z = pos.z;
+
+  double angle = sqrt(rot.x*rot.x + rot.y*rot.y + rot.z*rot.z);
+
+  if (angle > 0.0) {
+      poseStamped.pose.orientation.x = rot.x * sin(angle/2)/angle;
+      poseStamped.pose.orientation.y = rot.y * sin(angle/2)/angle;
+      poseStamped.pose.orientation.z = rot.z * sin(angle/2)/angle;
+      poseStamped.pose.orientation.w = cos(angle/2);
+  } else {
+      poseStamped.pose.orientation.x = 0;
+      poseStamped.pose.orientation.y = 0;
+      poseStamped.pose.orientation.z = 0;
+      poseStamped.pose.orientation.w = 1;
+  }
+  poseStampedPub.publish(poseStamped);
 }
 
 void TrackInit::sortPointsCW(std::vector<cv::Point> &points) {
@@ -167,35 +420,85 @@ void TrackInit::sortPointsCW(std::vector<cv::Point> &points) {
   }
 }
 
-std::vector<cv::Point> TrackInit::findSquare(const cv_bridge::CvImage img) {
-  std::vector<cv::Point> square;
+std::vector<std::vector<cv::Point> > TrackInit::findQuadrilaterals(const cv::Mat& img, const cv::Rect& roi,
+                                                                   double min_area, bool edges) {
   std::vector<std::vector<cv::Point> > contours;
-  // threshold to low value (square should be black)
+  std::vector<cv::Vec4i> hierarchy;
   cv::Mat im;
-  cv::threshold(img.image, im, 40, 255, cv::THRESH_BINARY_INV);
-  // find contours
-  cv::findContours(im, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE);
-    
-  // sort by decreasing area
-  std::sort(contours.begin(), contours.end(), [](const std::vector<cv::Point>& c1, const std::vector<cv::Point>& c2) {
-      return cv::contourArea(c1, false) > cv::contourArea(c2, false);
+  if (edges) {
+    // close the gaps between the events of an edge: an outline becomes a
+    // band with an outer and an inner contour, the marker is in between
+    static const cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+    cv::morphologyEx(img(roi), im, cv::MORPH_CLOSE, kernel);
+    // find contours and their holes, offset to image coordinates
+    cv::findContours(im, contours, hierarchy, cv::RETR_CCOMP, cv::CHAIN_APPROX_SIMPLE, roi.tl());
+  } else {
+    // threshold to low value (markers should be black)
+    cv::threshold(img(roi), im, 40, 255, cv::THRESH_BINARY_INV);
+    // find contours, offset to image coordinates
+    cv::findContours(im, contours, cv::RETR_LIST, cv::CHAIN_APPROX_SIMPLE, roi.tl());
+  }
+
+  // every contour tested once, in parallel, its area computed once
+  bool partial = roi.width < img.cols or roi.height < img.rows;
+  std::vector<std::vector<cv::Point> > approxes(contours.size());
+  std::vector<double> areas(contours.size(), 0);
+  parallelFor(contours.size(), [&](const cv::Range& range) {
+    for (int i = range.start; i < range.end; ++i) {
+      const std::vector<cv::Point>& contour = contours[i];
+      double area = cv::contourArea(contour);
+      if (area <= min_area) continue;
+      // a contour cut by the region is not the whole marker
+      if (partial) {
+        cv::Rect box = cv::boundingRect(contour);
+        if (box.x <= roi.x or box.y <= roi.y or box.x + box.width >= roi.x + roi.width or
+            box.y + box.height >= roi.y + roi.height)
+          continue;
+      }
+      // check if it's a quadrilateral, approximate with low tolerance 1% of
+      // length, 3% for the ragged edges of events
+      std::vector<cv::Point> approx;
+      cv::approxPolyDP(contour, approx, (edges ? 0.03 : 0.01)*cv::arcLength(contour, true), true);
+      if (approx.size() == 4 and cv::isContourConvex(approx)) {
+        sortPointsCW(approx);
+        approxes[i] = approx;
+        areas[i] = area;
+      }
+    }
   });
-  
-  // final square result
-  for (int i = 0; i < contours.size(); ++i) {
-      if (cv::contourArea(contours[i]) > 0.01*im.total()) { // at least 1% of image area
-          // check if it's a square, approximate with low tolerance 1% of length
-          std::vector<cv::Point> approx;
-          cv::approxPolyDP(contours[i], approx, 0.01*cv::arcLength(contours[i], true), true);
-          
-          if (approx.size() == 4) { // quadrilateral approximation
-              square = approx;
-              break;
-          }
+
+  // an outer quadrilateral of a band with an inner one is replaced by their
+  // average, the center line of the band, and the inner one is dropped:
+  // the outer one alone is too large, the camera would be too close
+  if (edges) {
+    for (size_t i = 0; i < contours.size(); ++i) {
+      if (approxes[i].empty() or hierarchy[i][3] >= 0) continue;
+      // largest quadrilateral hole
+      int inner = -1;
+      for (int h = hierarchy[i][2]; h >= 0; h = hierarchy[h][0])
+        if (!approxes[h].empty() and (inner < 0 or areas[h] > areas[inner])) inner = h;
+      if (inner < 0) continue;
+      for (cv::Point& p : approxes[i]) {
+        const cv::Point* nearest = &approxes[inner][0];
+        for (const cv::Point& q : approxes[inner])
+          if (cv::norm(q - p) < cv::norm(*nearest - p)) nearest = &q;
+        p = (p + *nearest)*0.5;
       }
+      areas[i] = cv::contourArea(approxes[i]);
+      approxes[inner].clear();
+    }
   }
-  return square;
+
+  // by decreasing area
+  std::vector<size_t> order;
+  for (size_t i = 0; i < approxes.size(); ++i)
+    if (!approxes[i].empty()) order.push_back(i);
+  std::sort(order.begin(), order.end(), [&areas](size_t i1, size_t i2) {
+      return areas[i1] > areas[i2];
+  });
+  std::vector<std::vector<cv::Point> > quads;
+  for (size_t i : order) quads.push_back(approxes[i]);
+  return quads;
 }
 
 } // namespace
-
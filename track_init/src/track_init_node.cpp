@@ -5,8 +5,9 @@ int main(int argc, char* argv[]) {
   ros::init(argc, argv, "track_init");
 
   ros::NodeHandle nh;
+  ros::NodeHandle pnh("~");
 
-  track::TrackInit tracker_init(nh);
+  track::TrackInit tracker_init(nh, pnh);
   ROS_INFO("started track_init");
   ros::spin();
 
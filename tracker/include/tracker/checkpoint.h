@@ -0,0 +1,33 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <cstdint>
+#include "efk.h"
+
+using std::vector;
+
+namespace track
+{
+
+// Filter checkpoint, to resume tracking right after a restart of the
+// tracker without waiting for track_init. The file is written to a
+// temporary file renamed over the previous one, so that a reader never
+// sees a partial checkpoint. Integers and doubles are little endian.
+//   magic "TRKCKP01" | written u64 | last_event_ts u64 |
+//   state 13 f64 (r, q w x y z, v, theta*u) | covariance 169 f64 (row-major) |
+//   camera matrix 4 f64 | distortion count u32 | distortion f64... |
+struct Checkpoint {
+    EFK::State X;
+    Mat13 P;
+    Vec4 K;                // camera matrix [u0 u1 fx fy]
+    vector<double> D;      // distortion [k1 k2 p1 p2 k3]
+    int64_t last_event_ts; // ns, event clock
+    int64_t written;       // ns, wall clock
+};
+
+// false on error
+bool writeCheckpoint(const std::string& path, const Checkpoint& checkpoint);
+// false if missing or not a checkpoint
+bool readCheckpoint(const std::string& path, Checkpoint& checkpoint);
+
+} // namespace
@@ -33,10 +33,13 @@ public:
 
     // initialize state
     void init(const EFK::State& X0, const Mat13& = Mat13::Zero());
+    // change the motion and measurement noise, state and covariance are kept
+    void setNoise(const Vec3& sigma_v, const Vec3& sigma_w, double sigma_d);
     // predict the next state after dt seconds
     void predict(double dt);
     // update state after distance measurement
-    void update(double dist, const Eigen::Matrix<double, 1, 7>& H);
+    // returns the normalized innovation squared z^2/Z
+    double update(double dist, const Eigen::Matrix<double, 1, 7>& H);
     
     // get current state
     EFK::State getState();
@@ -0,0 +1,89 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+namespace track
+{
+
+// event with its timestamp in nanoseconds
+struct PackedEvent {
+    uint16_t x;
+    uint16_t y;
+    bool polarity;
+    uint64_t t;
+};
+
+class EventEncoder {
+// Appends events in the compact format of PackedEventArray: zigzag varint
+// of the time delta (in unit nanoseconds) to the previous event, then x and
+// y|polarity<<15 as little endian uint16. Microsecond deltas mostly take a
+// single byte, so an event usually takes 5 bytes instead of 13.
+public:
+    EventEncoder(std::vector<uint8_t>& data, uint64_t t0, uint32_t unit) :
+        data_(data), last_(t0 / unit), unit_(unit) {}
+
+    inline void add(uint16_t x, uint16_t y, bool polarity, uint64_t t) {
+        int64_t dt = int64_t(t / unit_) - int64_t(last_);
+        last_ = t / unit_;
+        uint64_t zigzag = (uint64_t(dt) << 1) ^ uint64_t(dt >> 63);
+        while (zigzag >= 0x80) {
+            data_.push_back(uint8_t(zigzag) | 0x80);
+            zigzag >>= 7;
+        }
+        data_.push_back(uint8_t(zigzag));
+        uint16_t yp = (y & 0x7fff) | (polarity ? 0x8000 : 0);
+        data_.push_back(uint8_t(x));
+        data_.push_back(uint8_t(x >> 8));
+        data_.push_back(uint8_t(yp));
+        data_.push_back(uint8_t(yp >> 8));
+    }
+
+    // largest unit (1000 or 1 ns) keeping timestamps exact
+    static inline uint32_t unitFor(uint64_t t) {
+        return t % 1000 == 0 ? 1000 : 1;
+    }
+
+private:
+    std::vector<uint8_t>& data_;
+    uint64_t last_;
+    uint32_t unit_;
+};
+
+class EventDecoder {
+// Reads events written by EventEncoder, without copying the data
+public:
+    EventDecoder(const uint8_t* data, std::size_t size, uint64_t t0, uint32_t unit) :
+        p_(data), end_(data + size), last_(t0 / unit), unit_(unit) {}
+
+    // false at the end of the data or if it is truncated
+    inline bool next(PackedEvent& e) {
+        uint64_t zigzag = 0;
+        int shift = 0;
+        while (true) {
+            if (p_ >= end_ or shift > 63) return false;
+            uint8_t b = *p_++;
+            zigzag |= uint64_t(b & 0x7f) << shift;
+            if (!(b & 0x80)) break;
+            shift += 7;
+        }
+        if (end_ - p_ < 4) return false;
+        int64_t dt = int64_t(zigzag >> 1) ^ -int64_t(zigzag & 1);
+        last_ += dt;
+        uint16_t yp = uint16_t(p_[2]) | uint16_t(p_[3]) << 8;
+        e.x = uint16_t(p_[0]) | uint16_t(p_[1]) << 8;
+        e.y = yp & 0x7fff;
+        e.polarity = yp & 0x8000;
+        e.t = last_ * unit_;
+        p_ += 4;
+        return true;
+    }
+
+private:
+    const uint8_t* p_;
+    const uint8_t* end_;
+    uint64_t last_;
+    uint32_t unit_;
+};
+
+} // namespace
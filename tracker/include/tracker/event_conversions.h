@@ -0,0 +1,41 @@
+#pragma once
+#include <dvs_msgs/EventArray.h>
+#include <tracker/PackedEventArray.h>
+#include <algorithm>
+#include "tracker_core.h"
+#include "event_codec.h"
+
+namespace track
+{
+
+// ROS event messages and decoded events to TrackerCore batches, keeping
+// one event every TrackerCore::increment of the packet for at most max_events
+
+inline void toBatch(const dvs_msgs::EventArray& msg, vector<TrackerCore::Event>& batch,
+                    uint max_events = TrackerCore::EVENT_MAX_SIZE) {
+    const vector<dvs_msgs::Event>& events = msg.events;
+    uint increment = TrackerCore::increment(events.size(), max_events);
+    for (int i = 0; i < events.size(); i += increment)
+        batch.push_back(TrackerCore::Event { Point2d(events[i].x, events[i].y), int64_t(events[i].ts.toNSec()) });
+}
+
+inline void toBatch(const vector<PackedEvent>& events, vector<TrackerCore::Event>& batch,
+                    uint max_events = TrackerCore::EVENT_MAX_SIZE) {
+    uint increment = TrackerCore::increment(events.size(), max_events);
+    for (int i = 0; i < events.size(); i += increment)
+        batch.push_back(TrackerCore::Event { Point2d(events[i].x, events[i].y), int64_t(events[i].t) });
+}
+
+inline void toBatch(const tracker::PackedEventArray& msg, vector<TrackerCore::Event>& batch,
+                    uint max_events = TrackerCore::EVENT_MAX_SIZE) {
+    // every event is decoded for its timestamp delta but only the kept ones are stored
+    uint increment = TrackerCore::increment(msg.count, max_events);
+    EventDecoder decoder(msg.data.data(), msg.data.size(), msg.t0.toNSec(), std::max(1u, msg.dt_unit));
+    PackedEvent e;
+    for (uint i = 0; decoder.next(e); ++i) {
+        if (i % increment == 0)
+            batch.push_back(TrackerCore::Event { Point2d(e.x, e.y), int64_t(e.t) });
+    }
+}
+
+}
@@ -0,0 +1,97 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+#include "event_codec.h"
+
+namespace track
+{
+
+// Event log file: a header, chunks of events encoded like PackedEventArray
+// (see event_codec.h) and an index of the chunks at the end of the file.
+// Integers are little endian.
+//   header | magic "EVTLOG01" | width u32 | height u32 |
+//   chunk  | t_first u64 | t_last u64 | size u64 | count u32 | dt_unit u32 | data |
+//   ...
+//   index  | t_first u64 | t_last u64 | offset u64 | size u64 | count u32 | dt_unit u32 |
+//   ...
+//   footer | index offset u64 | chunks u64 | magic "EVTIDX01" |
+struct EventLogChunk {
+    uint64_t t_first;  // ns, reference of the deltas
+    uint64_t t_last;   // ns
+    uint64_t offset;   // of the data in the file
+    uint64_t size;     // bytes of data
+    uint32_t count;    // events
+    uint32_t dt_unit;  // ns per delta unit
+};
+
+class EventLogWriter {
+// Writes events in time order, a chunk every chunk_events events
+public:
+    explicit EventLogWriter(uint32_t chunk_events = 50000);
+    ~EventLogWriter();
+
+    // false if the file cannot be written
+    bool open(const std::string& path, uint32_t width, uint32_t height);
+    inline bool isOpen() const { return file_.is_open(); }
+    void add(const PackedEvent& e);
+    // write the last chunk and the index, false on error
+    bool close();
+
+private:
+    uint32_t chunk_events_;
+    std::ofstream file_;
+    // events of the current chunk, encoded once complete to pick the time unit
+    std::vector<PackedEvent> events_;
+    std::vector<uint8_t> data_;
+    std::vector<EventLogChunk> index_;
+    void writeChunk();
+};
+
+class EventLogReader {
+// Reads a log through mmap, events are decoded from the mapped chunks
+// without copies. Seeking is a binary search on the index followed by the
+// decoding of a single chunk.
+public:
+    EventLogReader();
+    ~EventLogReader();
+
+    // false if the file is missing or not a log. The index of a log that
+    // was not closed is rebuilt from its complete chunks
+    bool open(const std::string& path);
+    void close();
+
+    inline uint32_t getWidth() const { return width_; }
+    inline uint32_t getHeight() const { return height_; }
+    inline const std::vector<EventLogChunk>& getChunks() const { return index_; }
+    uint64_t size() const;
+    // time of the first and last events (ns), 0 if empty
+    uint64_t beginTime() const;
+    uint64_t endTime() const;
+
+    // position before the first event at or after t (ns)
+    void seek(uint64_t t);
+    // next event, false at the end of the log
+    bool next(PackedEvent& e);
+
+private:
+    const uint8_t* data_;
+    std::size_t size_;
+    uint32_t width_, height_;
+    std::vector<EventLogChunk> index_;
+    // chunk being decoded
+    std::size_t chunk_;
+    EventDecoder decoder_;
+    // event decoded by seek, returned by the next call to next
+    bool has_pending_;
+    PackedEvent pending_;
+    // index at the end of the file, false if missing or invalid
+    bool readIndex();
+    // index of the chunks found after the header
+    void rebuildIndex();
+    void startChunk(std::size_t chunk);
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <Eigen/Dense>
+#include <vector>
+#include <cstdint>
+#include "slam_line.h"
+#include "event_codec.h"
+
+using std::vector;
+
+namespace track
+{
+
+class EventSimulator {
+// Events of a camera moving in front of a segment map, in place of the
+// camera driver for load and regression tests. Events are sampled on the
+// projected segments with a density proportional to how fast each part
+// sweeps the image, at a fixed total rate, plus background noise. The
+// polarity is the side the edge moves to, each segment being brighter on
+// a random side.
+public:
+    struct Params {
+        double rate           = 1e6;  // events per second, noise included
+        double noise_ratio    = 0.05; // background noise events / events
+        double position_sigma = 0.5;  // px, noise on the position of edge events
+        double polarity_flip  = 0.05; // probability of the wrong polarity
+        uint width            = 240;
+        uint height           = 180;
+        Vec4 K = (Vec4() << 120, 90, 200, 200).finished(); // [u0 u1 fx fy]
+        // trajectory: r(t) = position + position_amplitude .* sin(2 pi position_frequency t)
+        Vec3 position           = Vec3(0, 0, -300); // mm
+        Vec3 position_amplitude = Vec3(40, 30, 20);
+        Vec3 position_frequency = Vec3(0.5, 0.7, 0.3); // Hz
+        // q(t) = orientation * rotations around x, y, z of
+        // rotation_amplitude .* sin(2 pi rotation_frequency t)
+        Quaternion orientation  = Quaternion::Identity();
+        Vec3 rotation_amplitude = Vec3(0.1, 0.1, 0.2); // rad
+        Vec3 rotation_frequency = Vec3(0.4, 0.6, 0.5); // Hz
+        uint64_t start_time     = 0; // ns, time of the trajectory origin
+        unsigned seed           = 1;
+    };
+
+    EventSimulator(const Params& params, const vector<SlamLine>& segments);
+
+    inline const Params& getParams() const { return params_; }
+    // ground truth camera pose at t (ns)
+    void getPose(uint64_t t, Vec3& r, Quaternion& q) const;
+    // append the events of [t0, t1) (ns) in time order
+    void generate(uint64_t t0, uint64_t t1, vector<PackedEvent>& events);
+
+private:
+    Params params_;
+    vector<SlamLine> segments_;
+    // side of each segment that is brighter
+    vector<bool> contrast_;
+    // xoroshiro128+, the std distributions are the bottleneck at 20 Mev/s
+    uint64_t state_[2];
+    inline double uniform() {
+        uint64_t s0 = state_[0], s1 = state_[1];
+        uint64_t result = s0 + s1;
+        s1 ^= s0;
+        state_[0] = ((s0 << 24) | (s0 >> 40)) ^ s1 ^ (s1 << 16);
+        state_[1] = (s1 << 37) | (s1 >> 27);
+        return (result >> 11)*(1.0/9007199254740992.0); // [0, 1) from 53 bits
+    }
+    // fractional event left from the previous call, keeps the rate exact
+    double carry_;
+    // projections and image velocities of the segments at the middle of a call
+    vector<Point2d> p1_, p2_, v1_, v2_;
+    vector<double> weights_;
+    // project a point, false if behind the camera
+    bool project(const Point3d& p, const Vec3& r, const Quaternion& q, Point2d& pixel) const;
+};
+
+}
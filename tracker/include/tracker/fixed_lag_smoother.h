@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <Eigen/Dense>
+#include "efk.h"
+#include "slam_line.h"
+#include "thread_pool.h"
+#include "pose_history.h"
+
+using std::vector;
+
+namespace track
+{
+
+class FixedLagSmoother {
+// Sliding window Gauss-Newton over the associated events of the last
+// packets, run in a worker of the thread pool while the filter goes on.
+// The window is one constant velocity motion from the filter state before
+// its first packet, which is also the prior, so that the events of the
+// window are not counted twice. Every event is linearized again at each
+// iteration, unlike in the filter. The refined state at the end of the
+// window is compared to the filter state at the same time in the pose
+// history, and the difference corrects the filter at a later packet. No
+// solve starts while a correction waits, so that each solve is relative to
+// a filter that includes the previous corrections.
+public:
+    struct Params {
+        double window           = 0.02; // seconds of events
+        uint max_measurements   = 2000; // events of the window used, evenly sampled
+        uint iterations         = 5;    // Gauss-Newton iterations
+        double huber            = 2;    // px, robust loss threshold
+        // inflation of the filter covariance of the prior: the filter is
+        // overconfident after thousands of updates per packet
+        double prior_scale      = 1e4;
+        double max_correction   = 50;   // mm, larger corrections are discarded
+    };
+    // an associated event
+    struct Measurement {
+        Point2d p;
+        int64_t ts;     // ns
+        Point3d p1, p2; // associated segment
+    };
+    // tangent space of the state: r, rotation of q (right), v, w
+    using Vec12 = Eigen::Matrix<double, 12, 1>;
+    using Mat12 = Eigen::Matrix<double, 12, 12>;
+
+    FixedLagSmoother(const Params& params, ThreadPool& pool);
+    ~FixedLagSmoother();
+
+    // forget the window, the filter was reset; K is the camera matrix [u0 u1 fx fy]
+    void init(const Vec4& K, double sigma_d);
+    // add a packet: the filter (X0, P0) at ts0 before it, the measurements
+    // associated in it and the time ts of its end. A solve of the window up
+    // to ts is started in the pool if none is running and no correction
+    // waits. Measurements are moved out.
+    void process(const EFK::State& X0, const Mat13& P0, int64_t ts0,
+                 vector<Measurement>& measurements, int64_t ts);
+    // apply the last solve to the filter if one finished since the last call,
+    // true in that case: the filter moves by the difference between the
+    // smoothed state and its own state at that time in history, and its
+    // covariance grows by that difference. A solve older than the history or
+    // than one window is dropped.
+    bool correct(EFK& efk, const PoseHistory& history);
+
+    // solve the window: refine S0 at ts0 with the prior (S0, information)
+    // and the measurements, S is S0 moved to ts. Returns false if it did
+    // not converge to a finite state.
+    static bool solve(const Params& params, const Vec4& K, double sigma_d,
+                      const EFK::State& S0, const Mat12& information, int64_t ts0,
+                      const vector<Measurement>& measurements, int64_t ts, EFK::State& S);
+    // information of the tangent space from a filter covariance at X
+    static Mat12 information(const EFK::State& X, const Mat13& P, double scale);
+    // X moved by dt seconds with constant velocity, as EFK::predict
+    static EFK::State move(const EFK::State& X, double dt);
+
+private:
+    Params params_;
+    ThreadPool& pool_;
+    // set by init() while a solve may run, the solve uses its own copies
+    Vec4 K_;
+    double sigma_d_;
+
+    // WINDOW, only touched by the filter thread
+    struct Packet {
+        EFK::State X0; // filter before the packet
+        Mat13 P0;
+        int64_t ts0;
+        size_t end;    // measurements_ index after its measurements
+    };
+    vector<Packet> packets_;
+    vector<Measurement> measurements_;
+
+    // SOLVE, inputs copied while no solve runs
+    std::atomic<bool> solving_;
+    Vec4 solve_K_;
+    double solve_sigma_d_;
+    EFK::State solve_X0_;
+    Mat12 solve_information_;
+    int64_t solve_ts0_, solve_ts_;
+    vector<Measurement> solve_measurements_;
+    // result, smoothed state at solve_ts_
+    std::mutex result_mutex_;
+    // init() was called during the solve
+    bool cancelled_;
+    bool has_result_;
+    EFK::State result_;
+    int64_t result_ts_;
+    void run();
+};
+
+} // namespace
@@ -0,0 +1,45 @@
+#pragma once
+#include <Eigen/Dense>
+#include "efk.h"
+
+namespace track
+{
+
+class IdleDetector {
+// Still camera detection: a DAVIS looking at a static scene only sends
+// noise, at a low rate. The camera is still after consecutive packets at a
+// low event rate with a slow filter, and moving again at the first packet
+// with a high rate or with many of its sampled events on the map.
+public:
+    struct Params {
+        double max_rate              = 20000; // events/s of the packets of a still camera
+        double max_velocity          = 20;    // mm/s
+        double max_angular_velocity  = 0.05;  // rad/s
+        uint still_packets           = 20;    // consecutive still packets before idle
+        uint subsampling             = 10;    // events associated while idle, one in
+        uint min_matched             = 10;    // sampled events matched, and
+        double min_association_ratio = 0.5;   // ratio of them for motion
+    };
+
+    IdleDetector();
+    explicit IdleDetector(const Params& params);
+
+    // start again after a filter reset, not idle
+    void reset();
+    // a tracked packet at rate events/s with the filter at X, true if the
+    // camera became still
+    bool checkStill(double rate, const EFK::State& X);
+    // a packet while idle at rate events/s, matched of the associated
+    // sampled events, true if the camera moves again
+    bool checkMoving(double rate, uint matched, uint associated);
+
+    inline bool isIdle() const { return idle_; }
+    inline uint getSubsampling() const { return params_.subsampling; }
+
+private:
+    Params params_;
+    bool idle_;
+    uint still_packets_;
+};
+
+} // namespace
@@ -0,0 +1,112 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <random>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include "slam_line.h"
+#include "shared_map.h"
+
+using std::vector;
+
+using Point2d = Eigen::Vector2d;
+using Point3d = Eigen::Vector3d;
+using Vec3 = Eigen::Vector3d;
+using Vec4 = Eigen::Vector4d;
+using Quaternion = Eigen::Quaterniond;
+
+namespace track
+{
+
+class LineMapper {
+// Grows the map from events that were not associated to any segment.
+// Unmatched events are grouped in short views where the pose is almost
+// constant, 2d lines are fitted in each view and triangulated against
+// older views. Everything runs in its own thread, the tracking thread
+// only pushes observations and never waits.
+public:
+    struct Params {
+        double view_duration     = 0.02;  // seconds of events per view
+        uint min_view_events     = 30;    // skip views with less events
+        uint ransac_iterations   = 50;
+        double inlier_distance   = 1.0;   // pixels
+        uint min_line_inliers    = 20;
+        uint max_lines_per_view  = 3;
+        uint history_views       = 30;    // views kept for triangulation
+        double min_parallax      = 0.05;  // sin of angle between back-projected planes
+        double min_length        = 10;    // mm
+        double merge_distance    = 3;     // pixels, closer segments are duplicates
+        uint max_observations    = 20000; // observations buffered, newer are dropped
+        uint max_new_segments    = 4;     // segments inserted at once
+        uint max_segments        = 200;   // segments added in total
+    };
+    // called from the mapping thread with new segments
+    using SegmentsCallback = std::function<void(const vector<SlamLine>& segments)>;
+
+    // segments already in map are not added again
+    LineMapper(const Params& params, const std::shared_ptr<const SharedMap>& map,
+               const SegmentsCallback& callback);
+    ~LineMapper();
+
+    // camera matrix [u0 u1 fx fy] of the undistorted events
+    void setCameraMatrix(const Vec4& K);
+    // add an unmatched undistorted event seen at t from pose r,q
+    // never blocks, the observation is dropped if the buffer is busy or full
+    void addObservation(const Point2d& p, double t, const Vec3& r, const Quaternion& q);
+
+private:
+    struct Observation {
+        Point2d p;
+        double t;
+        Vec3 r;
+        Quaternion q;
+    };
+    // 2d line fitted in a view, l is normalized so that l[0]^2 + l[1]^2 = 1
+    struct ViewLine {
+        Vec3 l;
+        Point2d e1, e2; // extremes of the inliers
+        int view;
+    };
+    struct View {
+        Vec3 r;
+        Quaternion q;
+        int id;
+    };
+
+    Params params_;
+    std::shared_ptr<const SharedMap> map_;
+    SegmentsCallback callback_;
+
+    // shared with the tracking thread
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    vector<Observation> buffer_;
+    Vec4 K_;
+    bool got_camera_matrix_;
+    bool running_;
+
+    // only used by the mapping thread
+    std::thread thread_;
+    std::deque<Observation> pending_;
+    std::deque<View> views_;
+    std::deque<ViewLine> lines_;
+    vector<SlamLine> added_;
+    int next_view_id_;
+    std::minstd_rand rng_;
+
+    void run();
+    void processView(const vector<Observation>& obs, const Vec4& K);
+    void fitLines(vector<Point2d> points, int view, vector<ViewLine>& lines);
+    bool triangulate(const ViewLine& a, const ViewLine& b, const Vec4& K, SlamLine& segment);
+    bool isConfirmed(const SlamLine& segment, const ViewLine& a, const ViewLine& b, const Vec4& K);
+    // true if segment projects over one of segments in view v
+    bool isDuplicate(const SlamLine& segment, const vector<SlamLine>& segments,
+                     const View& v, const Vec4& K);
+    const View* findView(int id) const;
+};
+
+} // namespace
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include <sstream>
+#include <functional>
+
+namespace track
+{
+namespace log
+{
+
+// Logging of the core library, without ROS. Messages go to std::cerr from
+// Info by default, the nodes forward them to rosconsole.
+enum Level { Debug, Info, Warn, Error };
+
+// enabled is checked before formatting a message, it should be cheap
+using Handler = std::function<void(Level, const std::string&)>;
+using Filter = std::function<bool(Level)>;
+// set before starting the trackers, not thread safe
+void setHandler(const Handler& handler, const Filter& enabled);
+
+bool enabled(Level level);
+void write(Level level, const std::string& message);
+
+}
+}
+
+#define TRACK_LOG_STREAM(level, args) do { \
+    if (track::log::enabled(level)) { \
+        std::ostringstream track_log_ss__; \
+        track_log_ss__ << args; \
+        track::log::write(level, track_log_ss__.str()); \
+    } } while (0)
+#define TRACK_DEBUG_STREAM(args) TRACK_LOG_STREAM(track::log::Debug, args)
+#define TRACK_INFO_STREAM(args) TRACK_LOG_STREAM(track::log::Info, args)
+#define TRACK_WARN_STREAM(args) TRACK_LOG_STREAM(track::log::Warn, args)
+#define TRACK_ERROR_STREAM(args) TRACK_LOG_STREAM(track::log::Error, args)
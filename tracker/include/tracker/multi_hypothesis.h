@@ -0,0 +1,76 @@
+#pragma once
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <Eigen/Dense>
+#include "efk.h"
+#include "slam_line.h"
+#include "thread_pool.h"
+
+using std::vector;
+
+namespace track
+{
+
+class MultiHypothesis {
+// K filters with different motion noise run on the measurements associated
+// by the main filter, each one in a worker of the thread pool while the
+// main filter handles the next packet. Hypotheses are ranked by their
+// (decaying) measurement log-likelihood, the main filter adopts the best
+// one and hypotheses far behind are respawned from it.
+public:
+    struct Params {
+        uint hypotheses      = 5;    // number of filters
+        double scale_ratio   = 2;    // sigma_v, sigma_w ratio between consecutive hypotheses
+        double decay         = 0.9;  // log-likelihood forgetting per packet
+        double switch_margin = 5;    // log-likelihood needed to switch hypothesis
+        double prune_margin  = 50;   // hypotheses this far behind the best are respawned
+    };
+    // an associated event, dt is the time since the previous measurement
+    struct Measurement {
+        Point2d p;
+        double dt;
+        Point3d p1, p2; // associated segment
+    };
+
+    MultiHypothesis(const Params& params, const Vec3& sigma_v, const Vec3& sigma_w,
+                    double sigma_d, ThreadPool& pool);
+    ~MultiHypothesis();
+
+    // restart every hypothesis from X0, K is the camera matrix [u0 u1 fx fy]
+    void init(const EFK::State& X0, const Vec4& K);
+    // noise of the main filter settings, the hypotheses keep their scales
+    void setNoise(const Vec3& sigma_v, const Vec3& sigma_w, double sigma_d);
+    // process the measurements of a packet in background, they are swapped out
+    void process(vector<Measurement>& measurements);
+    // wait for the last packet, prune and respawn hypotheses and copy the
+    // best filter in efk if the selection changed, returns true in that case
+    bool select(EFK& efk);
+
+    // index and noise scale of the selected hypothesis
+    inline uint getSelected() const { return selected_; }
+    inline double getScale(uint i) const { return scales_[i]; }
+
+private:
+    struct Hypothesis {
+        EFK efk;
+        double log_likelihood;
+    };
+    Params params_;
+    ThreadPool& pool_;
+    vector<Hypothesis> hypotheses_;
+    vector<double> scales_;
+    uint selected_;
+    Vec4 K_;
+
+    vector<Measurement> measurements_;
+    // tasks still running
+    uint pending_;
+    std::mutex mutex_;
+    std::condition_variable done_;
+
+    void wait();
+    void run(Hypothesis& h);
+};
+
+} // namespace
@@ -0,0 +1,67 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include "efk.h"
+
+using std::vector;
+
+namespace track
+{
+
+class PoseHistory {
+// Recent filter states keyed by event time, to answer the pose at the
+// timestamp of another sensor. Past times are interpolated (slerp for the
+// orientation) between the two surrounding states, times after the last
+// state are extrapolated with its constant velocity.
+// One writer (the tracking thread) and any number of readers without lock:
+// each slot of the ring is a seqlock, a reader retries when the writer
+// overwrote the slot it was reading, the writer never waits.
+public:
+    struct Params {
+        uint size                 = 4096;      // states kept
+        int64_t period            = 1000000;   // ns, minimum time between two states
+        int64_t max_extrapolation = 100000000; // ns, furthest prediction after the last state
+    };
+
+    explicit PoseHistory(const Params& params);
+
+    // add the state at ts if at least period after the last one, or forced.
+    // An older ts than the last one starts a new history.
+    void add(const EFK::State& S, int64_t ts, bool force = false);
+    // forget every state, by the writer
+    void clear();
+
+    // state at ts, false if older than the history or too far after it
+    bool get(int64_t ts, EFK::State& S) const;
+    // time span of the history, false if empty
+    bool getRange(int64_t& begin, int64_t& end) const;
+
+private:
+    // state as relaxed atomics, valid when seq is the (index + 1) of its entry
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        std::atomic<int64_t> ts;
+        std::atomic<double> x[13]; // r q(w x y z) v w(theta*u)
+    };
+
+    Params params_;
+    std::unique_ptr<Slot[]> slots_;
+    // entries written, entry i is in slot i % size
+    std::atomic<uint64_t> end_;
+    // first entry of the current history
+    std::atomic<uint64_t> begin_;
+    // writer only
+    int64_t last_ts_;
+
+    // copy of entry i, false if overwritten meanwhile
+    bool read(uint64_t i, int64_t& ts, double x[13]) const;
+    // entries [begin, end) readable
+    void range(uint64_t& begin, uint64_t& end) const;
+    // one lookup of get, false if the writer overwrote an entry read
+    bool tryGet(int64_t ts, EFK::State& S, bool& found) const;
+    static EFK::State toState(const double x[13]);
+};
+
+} // namespace
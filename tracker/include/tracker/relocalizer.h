@@ -0,0 +1,66 @@
+#pragma once
+#include <vector>
+#include <Eigen/Dense>
+#include <Eigen/Geometry>
+#include "slam_line.h"
+#include "thread_pool.h"
+
+using std::vector;
+
+using Point2d = Eigen::Vector2d;
+using Vec3 = Eigen::Vector3d;
+using Vec4 = Eigen::Vector4d;
+using Quaternion = Eigen::Quaterniond;
+using AngleAxis = Eigen::AngleAxisd;
+
+namespace track
+{
+
+class Relocalizer {
+// Event-only relocalization: keeps the last second of undistorted events
+// and searches the pose around a guess whose projected map explains them
+// best. The search is a coarse-to-fine grid over position and orientation,
+// candidates of each level are scored in parallel in the thread pool.
+public:
+    struct Params {
+        double history_duration = 1.0;  // seconds of events kept
+        uint history_size       = 200000; // maximum events kept
+        uint max_events         = 1000; // newest events used for scoring
+        uint levels             = 4;    // grid refinements
+        uint level_iterations   = 3;    // grid moves per level while it improves
+        double step_position    = 20;   // mm, grid step of the first level
+        double step_angle       = 0.1;  // radians, grid step of the first level
+        double sigma            = 2.0;  // pixels, distance scale of the score
+        double min_score        = 0.3;  // mean score per event to accept a pose
+    };
+
+    Relocalizer(const Params& params, ThreadPool& pool);
+
+    // add an undistorted event at time t (seconds)
+    void addEvent(const Point2d& p, double t);
+    void clear();
+
+    // search a pose around r0,q0 explaining the recent events
+    // r,q is the best pose found, false if its score is below min_score
+    bool relocalize(const vector<SlamLine>& segments, const Vec4& K,
+                    const Vec3& r0, const Quaternion& q0,
+                    Vec3& r, Quaternion& q, double& score);
+
+    // mean score per event of a pose, 1 if every event lies on a segment
+    static double score(vector<SlamLine>& segments, const vector<Point2d>& events,
+                        const Vec4& K, const Vec3& r, const Quaternion& q, double sigma);
+
+private:
+    struct Event {
+        Point2d p;
+        double t;
+    };
+    Params params_;
+    ThreadPool& pool_;
+    // ring buffer of recent events
+    vector<Event> history_;
+    uint head_;  // next position to write
+    uint count_;
+};
+
+} // namespace
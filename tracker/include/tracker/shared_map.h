@@ -0,0 +1,50 @@
+#pragma once
+#include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "slam_line.h"
+
+using std::vector;
+
+namespace track
+{
+
+class SharedMap {
+// Read-only 3d segments shared by all the trackers of a process.
+// Writers (map loader, line mappers) publish a new version of the whole
+// segment list, readers never lock: they check the version and keep the
+// segments they hold until they built their own projected TrackerMap.
+public:
+    using Segments = std::shared_ptr<const vector<SlamLine> >;
+
+    // starts with the default map of TrackerMap
+    SharedMap();
+    ~SharedMap();
+
+    inline uint getVersion() const { return version_; }
+    // segments at least as new as the version read before
+    inline Segments getSegments() const { return std::atomic_load(&segments_); }
+
+    // replace all segments
+    void setSegments(const vector<SlamLine>& segments);
+    // add segments to the current ones
+    void appendSegments(const vector<SlamLine>& segments);
+
+    // load a map file (see TrackerMap::loadSegments), false on error
+    bool load(const std::string& path);
+    // load a map file in a background thread, false if already loading
+    bool loadAsync(const std::string& path);
+
+private:
+    Segments segments_;
+    std::atomic<uint> version_;
+    // serializes writers
+    std::mutex mutex_;
+    std::thread loader_;
+    std::atomic<bool> loading_;
+};
+
+} // namespace
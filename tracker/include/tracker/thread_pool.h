@@ -0,0 +1,43 @@
+#pragma once
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace track
+{
+
+class ThreadPool {
+// Fixed set of worker threads shared by the parallel parts of the tracker
+public:
+    // 0 threads means one per hardware thread
+    explicit ThreadPool(uint threads = 0);
+    ~ThreadPool();
+
+    inline uint size() const { return workers_.size(); }
+
+    // run task in a worker
+    void enqueue(const std::function<void()>& task);
+    // call f(begin, end) on chunks covering [0, n) in the workers and the
+    // calling thread, returns once every chunk is done
+    void parallelFor(uint n, const std::function<void(uint begin, uint end)>& f);
+
+private:
+    std::vector<std::thread> workers_;
+    // ring of queued tasks, grown when full: unlike a deque it does not
+    // allocate in the steady state
+    std::vector<std::function<void()> > tasks_;
+    size_t head_, queued_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool running_;
+
+    void run();
+    bool tryPop(std::function<void()>& task);
+    // with mutex_ held
+    void push(const std::function<void()>& task);
+    void pop(std::function<void()>& task);
+};
+
+} // namespace
@@ -0,0 +1,62 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace track
+{
+namespace trace
+{
+
+// Timeline of spans (name, begin, end, argument) exported as a Chrome trace
+// (chrome://tracing, ui.perfetto.dev). Each thread records into its own
+// preallocated ring buffer that keeps the last spans, no lock nor
+// allocation once started. Spans are only compiled with TRACKER_TRACING
+// (cmake -DTRACING=ON), otherwise the TRACK_TRACE macros are empty.
+
+// start recording, with the capacity of the buffer of each thread
+void enable(size_t spans_per_thread = 1 << 16);
+bool enabled();
+// name of the calling thread in the trace
+void setThreadName(const std::string& name);
+// write the spans of all threads as Chrome trace JSON, false on error.
+// Spans recorded meanwhile may be missing.
+bool write(const std::string& path);
+
+// ns of the trace clock
+uint64_t now();
+void record(const char* name, uint64_t begin, uint64_t end, int64_t arg);
+
+class Scope {
+// a span over its scope, name must be a string literal
+public:
+    inline Scope(const char* name, int64_t arg = -1) :
+        name_(enabled() ? name : nullptr), arg_(arg) {
+        if (name_) begin_ = now();
+    }
+    inline ~Scope() {
+        if (name_) record(name_, begin_, now(), arg_);
+    }
+private:
+    const char* name_;
+    int64_t arg_;
+    uint64_t begin_;
+};
+
+}
+}
+
+#ifdef TRACKER_TRACING
+#define TRACK_TRACE_CONCAT_(a, b) a ## b
+#define TRACK_TRACE_CONCAT(a, b) TRACK_TRACE_CONCAT_(a, b)
+// span over the rest of the scope, with an optional argument (event count...)
+#define TRACK_TRACE_SCOPE(name) \
+    track::trace::Scope TRACK_TRACE_CONCAT(track_trace_scope__, __LINE__)(name)
+#define TRACK_TRACE_SCOPE_ARG(name, arg) \
+    track::trace::Scope TRACK_TRACE_CONCAT(track_trace_scope__, __LINE__)(name, int64_t(arg))
+#define TRACK_TRACE_THREAD(name) track::trace::setThreadName(name)
+#else
+#define TRACK_TRACE_SCOPE(name) do {} while (0)
+#define TRACK_TRACE_SCOPE_ARG(name, arg) do {} while (0)
+#define TRACK_TRACE_THREAD(name) do {} while (0)
+#endif
@@ -1,108 +1,182 @@
 #pragma once
 #include <ros/ros.h>
+#include <ros/callback_queue.h>
 
 #include <image_transport/image_transport.h>
-#include <cv_bridge/cv_bridge.h>
 #include <std_msgs/Bool.h>
+#include <std_msgs/String.h>
 #include <sensor_msgs/Image.h>
 #include <sensor_msgs/image_encodings.h>
 #include <sensor_msgs/CameraInfo.h>
 #include <geometry_msgs/PoseStamped.h>
+#include <diagnostic_msgs/DiagnosticArray.h>
 #include <dvs_msgs/Event.h>
 #include <dvs_msgs/EventArray.h>
+#include <tracker/PackedEventArray.h>
+#include <tracker/TrackerConfig.h>
+#include <tracker/GetPose.h>
+#include <dynamic_reconfigure/server.h>
 
 #include <Eigen/Dense>
 #include <opencv2/opencv.hpp>
 #include <vector>
+#include <string>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
 
-#include "efk.h"
-#include "tracker_map.h"
-
-using Point2d = Eigen::Vector2d;
-using Vec3 = Eigen::Vector3d;
-using Vec4 = Eigen::Vector4d;
-using Quaternion = Eigen::Quaterniond;
-using AngleAxis = Eigen::AngleAxisd;
-
-using std::vector;
+#include "tracker_core.h"
+#include "event_conversions.h"
 
 namespace track {
 
 class Tracker {
+// ROS node around TrackerCore: parameters, topics, event path and visualization
 public:
-    struct Event {
-        Point2d p;
-        ros::Time ts;
-    };
-    Tracker(ros::NodeHandle & nh);
+    using Event = TrackerCore::Event;
+    // topics on nh and parameters on the private pnh. map and pool can be
+    // shared by several trackers, they are created if null
+    Tracker(ros::NodeHandle & nh, ros::NodeHandle & pnh,
+            const std::shared_ptr<SharedMap>& map = std::shared_ptr<SharedMap>(),
+            const std::shared_ptr<ThreadPool>& pool = std::shared_ptr<ThreadPool>());
     virtual ~Tracker();
-    
-    // uncertainty in movement per second
-    const Vec3 sigma_v = (Eigen::Vector3d() << 2, 2, 2).finished();
-    const Vec3 sigma_w = (Eigen::Vector3d() << 4, 4, 4).finished();
-    // uncertainty in measurement of pixel-segment distance
-    const double sigma_d    = 1;
-    // maximum distance to match event to line
-    const double MATCHING_DIST_THRESHOLD = 2.5;
-    // minimum margin between 1st and 2nd distance
-    const double MATCHING_DIST_MIN_MARGIN = 10;
+
+    // seconds between two reports of the event backlog
+    const double BACKLOG_REPORT_PERIOD = 5;
 
     const uint IMAGE_WIDTH = 240;
     const uint IMAGE_HEIGHT = 180;
 private:
     ros::NodeHandle nh_;
-    EFK efk_;
-    TrackerMap map_;
+    // serializes the control callbacks and the event worker on core_
+    std::mutex mutex_;
+    std::unique_ptr<TrackerCore> core_;
+    // 3d segments, maybe shared with other trackers
+    std::shared_ptr<SharedMap> shared_map_;
+    // workers for parallel work
+    std::shared_ptr<ThreadPool> pool_;
 
     void cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg);
     void cameraPoseCallback(const geometry_msgs::PoseStamped::ConstPtr& msg);
     void resetCallback(const std_msgs::Bool::ConstPtr& msg);
     void eventsCallback(const dvs_msgs::EventArray::ConstPtr& msg);
-
-    void publishTrackedPose(const EFK::State& S);
+    void packedEventsCallback(const tracker::PackedEventArray::ConstPtr& msg);
+    void loadMapCallback(const std_msgs::String::ConstPtr& msg);
+    void writeTraceCallback(const std_msgs::String::ConstPtr& msg);
+    void backlogReportCallback(const ros::WallTimerEvent& event);
+
+    // CHECKPOINT
+    // filter state and calibration written every checkpoint_period seconds
+    // off the event path, and resumed at startup when fresh, none if empty
+    std::string checkpoint_file_;
+    ros::WallTimer checkpoint_timer_;
+    // resumed from a checkpoint, camera_info only checks its calibration
+    bool restored_calibration_;
+    // resume from checkpoint_file_ if written less than max_age seconds ago
+    bool restoreCheckpoint(double max_age);
+    void writeCheckpoint();
+    void checkpointCallback(const ros::WallTimerEvent& event);
+
+    // TUNING
+    // cfg/Tracker.cfg, initialized from the node parameters, applied
+    // between packets with mutex_
+    std::unique_ptr<dynamic_reconfigure::Server<tracker::TrackerConfig> > reconfigure_server_;
+    void reconfigureCallback(tracker::TrackerConfig& config, uint32_t level);
+
+    // pose of the filter after the event at ts (ns)
+    void publishTrackedPose(const EFK::State& S, int64_t ts);
+    // pose at a past or near future time from the pose history of the
+    // core, without waiting for the tracker lock
+    ros::ServiceServer get_pose_srv_;
+    bool getPoseCallback(tracker::GetPose::Request& req, tracker::GetPose::Response& res);
     
     // DEPENDENCIES
     // pose msg as initial pose
     ros::Subscriber starting_pose_sub_;
     // reset EFK tracking flag
     ros::Subscriber reset_sub_;
-    // events from camera
+    // events from camera, as dvs_msgs or packed
     ros::Subscriber event_sub_;
-
-    // CAMERA INFO
-    bool got_camera_info_;
-    Vec4 camera_matrix_; // [u0 u1 fx fy]
-
-    /*     opencv camera matrix and coefs
-       [fx  0  u0]
-       [0  fy  u1]      [k1 k2 p1 p2 k3...]
-       [0   0   1]
-    */
-    cv::Mat camera_matrix_cv, dist_coeffs_cv;
+    ros::Subscriber packed_event_sub_;
     ros::Subscriber camera_info_sub_;
-    // last camera pose
-    bool got_camera_pose_; // from tracker_init
-    Vec3 camera_position_; // x,y,z
-    Quaternion camera_orientation_; // quaternion x,y,z,w
-
-    // TRACKING VARIABLES
-    bool is_tracking_running_;
-    ros::Time last_event_ts;
-    void handleEvent(const Tracker::Event &e);
-
-    // UNDISTORT EVENTS
-    Vec3 undist_coeffs;
-    void undistortEvent(Tracker::Event &e);
+    // path of a new map file to load
+    ros::Subscriber load_map_sub_;
+    // path of a Chrome trace to write (see trace.h)
+    ros::Subscriber write_trace_sub_;
+
+    // EVENT PATH
+    // events are received on their own queue and spinner thread, separated
+    // from the control topics, and put in a bounded backlog of packets
+    // processed by event_worker_
+    ros::CallbackQueue events_queue_;
+    std::unique_ptr<ros::AsyncSpinner> events_spinner_;
+    std::thread event_worker_;
+    std::mutex backlog_mutex_;
+    std::condition_variable backlog_cond_;
+    // a packet of either message type, the other pointer is null
+    struct Packet {
+        dvs_msgs::EventArray::ConstPtr events;
+        tracker::PackedEventArray::ConstPtr packed;
+    };
+    // ring of max_backlog_ packets, preallocated
+    std::vector<Packet> backlog_;
+    size_t backlog_head_, backlog_size_;
+    uint max_backlog_;
+    bool event_worker_running_;
+    // packets received/dropped (oldest first when the backlog is full) and
+    // worst lag between the last event of a packet and its processing
+    uint64_t received_packets_, dropped_packets_;
+    uint64_t reported_received_, reported_dropped_;
+    double max_lag_;
+    ros::WallTimer backlog_report_timer_;
+    void queuePacket(const Packet& packet);
+    void processEvents();
+    // events of the packet being processed, reserved for the largest batch
+    vector<Tracker::Event> batch_;
+    // fill batch_ with the (subsampled) events of a packet, false if empty
+    bool decodePacket(const Packet& packet);
+    // events of a packet before subsampling
+    static size_t packetSize(const Packet& packet);
+
+    // INSTRUMENTATION
+    // stages and counters of the core (see TrackerStats) are collected every
+    // stats_period seconds and published on /diagnostics, totals are
+    // reported on shutdown
+    double stats_period_;
+    ros::WallTimer stats_timer_;
+    ros::Publisher diagnostics_pub_;
+    // events of dropped packets, since the last collection (backlog_mutex_)
+    uint64_t dropped_events_;
+    // since startup, only touched by the stats timer and the destructor
+    TrackerStats total_stats_;
+    // file written with the totals on shutdown, none if empty
+    std::string stats_file_;
+    void statsCallback(const ros::WallTimerEvent& event);
+    // Chrome trace written on shutdown, none if empty
+    std::string trace_file_;
+    void writeTrace(const std::string& path);
+    // stats of the core since the last call, cleared there
+    void collectStats(TrackerStats& stats);
 
     // VISUALIZATION
     // publish pose
     ros::Publisher pose_pub_;
+    // reused for every pose, camera and body
+    geometry_msgs::PoseStamped pose_msg_;
+    // body pose from the camera extrinsics (camera pose in the body frame)
+    bool has_extrinsics_;
+    Vec3 body_t_cam_;
+    Quaternion body_q_cam_;
+    ros::Publisher body_pose_pub_;
     // debug event association
     image_transport::Publisher map_events_pub_;
-    // image of map and events
+    // image of map and events, drawn in place in the buffer of its message
+    sensor_msgs::Image map_events_msg_;
     cv::Mat map_events_;
-    // number of events to acumulate before publishing a map image
-    const uint PUBLISH_MAP_EVENTS_RATE = 1000;
+    // number of events to acumulate before publishing a map image, 0 never
+    uint publish_map_events_rate_;
     uint event_counter_;
     void updateMapEvents(const Tracker::Event &e, bool used = false);
 };
@@ -0,0 +1,251 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+
+#include "efk.h"
+#include "tracker_map.h"
+#include "line_mapper.h"
+#include "tracking_monitor.h"
+#include "idle_detector.h"
+#include "thread_pool.h"
+#include "relocalizer.h"
+#include "multi_hypothesis.h"
+#include "fixed_lag_smoother.h"
+#include "shared_map.h"
+#include "tracker_stats.h"
+#include "pose_history.h"
+#include "checkpoint.h"
+#include "log.h"
+
+using Point2d = Eigen::Vector2d;
+using Vec3 = Eigen::Vector3d;
+using Vec4 = Eigen::Vector4d;
+using Quaternion = Eigen::Quaterniond;
+using AngleAxis = Eigen::AngleAxisd;
+
+using std::vector;
+
+namespace track {
+
+class TrackerCore {
+// Event tracking without transport: calibration, camera poses and batches
+// of events go in, the filter state comes out. Not thread safe, the node
+// serializes its callbacks and the offline runner calls it from one thread.
+// No ROS dependency, times are integer nanoseconds.
+public:
+    struct Event {
+        Point2d p;
+        int64_t ts; // ns
+    };
+    struct Params {
+        bool auto_reset         = true;  // wait for a fresh camera pose when tracking is lost
+        bool relocalization     = true;  // search the pose from events meanwhile
+        int hypotheses          = 0;     // filters with scaled motion noise, when > 1
+        bool mapping            = false; // grow the map with unmatched events
+        unsigned stats_sampling = 16;    // time the stages of one event in that many, 0 never
+        bool idle_mode          = false; // freeze the pose and sample few events while the camera is still
+        bool auto_start         = false; // start from consistent camera poses, without start()
+        int start_poses         = 3;     // consecutive consistent camera poses to auto start
+        double start_buffer     = 0.5;   // seconds of events kept until the auto start
+        bool smoothing          = false; // refine the filter with a fixed-lag smoother in the pool
+    };
+    // filter and association settings that can change while tracking
+    struct Tuning {
+        // uncertainty in movement per second
+        Vec3 sigma_v = Vec3(2, 2, 2);
+        Vec3 sigma_w = Vec3(4, 4, 4);
+        // uncertainty in measurement of pixel-segment distance
+        double sigma_d = 1;
+        // maximum distance to match event to line
+        double matching_threshold = 2.5;
+        // minimum margin between 1st and 2nd distance
+        double matching_margin = 10;
+        // events of a packet kept, see increment
+        uint event_max_size = EVENT_MAX_SIZE;
+    };
+    // called after every filter update, with the timestamp of the event
+    using PoseCallback = std::function<void(const EFK::State&, int64_t ts)>;
+    // called for every tracked event, used if it updated the filter
+    using EventCallback = std::function<void(const Event&, bool used)>;
+
+    TrackerCore(const Params& params, const std::shared_ptr<SharedMap>& map,
+                const std::shared_ptr<ThreadPool>& pool);
+    ~TrackerCore();
+
+    void setPoseCallback(const PoseCallback& callback) { pose_callback_ = callback; }
+    void setEventCallback(const EventCallback& callback) { event_callback_ = callback; }
+
+    // camera matrix [u0 u1 fx fy] and distortion [k1 k2 p1 p2 k3]
+    void setCalibration(const Vec4& K, const vector<double>& D);
+    // camera pose from track_init, resets the filter if it comes after a divergence
+    void setCameraPose(const Vec3& r, const Quaternion& q, int64_t stamp);
+    // (re)start tracking from the last camera pose
+    void start();
+    // undistort and track a batch of events, in time order
+    void processEvents(vector<Event>& events);
+    // filter state and calibration to resume from, false unless tracking
+    // well. The written stamp is left to the caller.
+    bool getCheckpoint(Checkpoint& checkpoint);
+    // calibration and filter state of a checkpoint, tracking resumes with
+    // the next event
+    void restore(const Checkpoint& checkpoint);
+    // undistort an event in place with the calibration of setCalibration
+    void undistortEvent(Event &e);
+
+    // change the tuning between batches, the filter state is kept
+    void setTuning(const Tuning& tuning);
+    inline const Tuning& getTuning() const { return tuning_; }
+
+    // keep one event every increment(n) of a packet of n events
+    static inline uint increment(size_t events, uint max_events = EVENT_MAX_SIZE) {
+        return max_events ? events / max_events + 1 : 1;
+    }
+
+    inline bool isTracking() const { return is_tracking_running_; }
+    inline bool isIdle() const { return idle_ and idle_->isIdle(); }
+    inline bool hasCalibration() const { return got_camera_info_; }
+    inline const Vec4& getCameraMatrix() const { return camera_matrix_; }
+    inline const vector<double>& getDistortion() const { return distortion_; }
+    inline EFK::State getState() { return efk_.getState(); }
+    inline Mat13 getCovariance() { return efk_.getCovariance(); }
+    inline TrackerMap& getMap() { return *map_; }
+    inline const SharedMap& getSharedMap() const { return *shared_map_; }
+    // timings and counters, the node adds its own stages
+    inline TrackerStats& getStats() { return stats_; }
+    // recent states by event time, can be read from any thread
+    inline const PoseHistory& getPoseHistory() const { return history_; }
+
+    // seconds of events between two relocalization attempts
+    const double RELOCALIZATION_PERIOD = 0.1;
+    // largest change between consecutive camera poses that are consistent
+    const double START_MAX_POSITION_CHANGE = 10; // mm
+    const double START_MAX_ANGLE_CHANGE = 0.05;  // radians
+    // events kept until the auto start
+    static const uint START_BUFFER_SIZE = 500000;
+    // handle variable amount of events, this is STUPID, EASY and NOT ADAPTATIVE !!!
+    static const uint EVENT_MAX_SIZE = 2000;
+
+private:
+    Tuning tuning_;
+    EFK efk_;
+    // 3d segments, maybe shared with other trackers
+    std::shared_ptr<SharedMap> shared_map_;
+    // projected map used for association, only touched between batches
+    std::shared_ptr<TrackerMap> map_;
+
+    PoseCallback pose_callback_;
+    EventCallback event_callback_;
+
+    // MAP UPDATES
+    // version of shared_map_ of the last map built
+    uint map_version_;
+    // map built in the pool, swapped in by swapMap between batches
+    // (read and written with std::atomic_load/atomic_exchange)
+    std::shared_ptr<TrackerMap> next_map_;
+    std::atomic<bool> map_building_;
+    // build the projected map of a new shared_map_ version and swap in a ready one
+    void updateMap();
+    // replace map_ with next_map_ if a new one is ready
+    void swapMap();
+
+    // MAPPING
+    // grows the map with unmatched events, null if mapping is disabled
+    std::unique_ptr<LineMapper> mapper_;
+
+    // CAMERA INFO
+    bool got_camera_info_;
+    Vec4 camera_matrix_; // [u0 u1 fx fy]
+    vector<double> distortion_; // [k1 k2 p1 p2 k3]
+    // last camera pose
+    bool got_camera_pose_; // from tracker_init
+    Vec3 camera_position_; // x,y,z
+    Quaternion camera_orientation_; // quaternion x,y,z,w
+
+    // TRACKING VARIABLES
+    bool is_tracking_running_;
+    int64_t last_event_ts; // 0 before the first event
+    // init the filter from a camera pose and start tracking
+    void reset(const Vec3& r, const Quaternion& q);
+    void reset(const EFK::State& X0, const Mat13& P0);
+
+    // states since the last reset
+    PoseHistory history_;
+
+    // AUTO START
+    bool auto_start_;
+    // tracking started once, by start(), a fresh pose or the auto start
+    bool started_;
+    // consecutive consistent camera poses received
+    int start_poses_, consistent_poses_;
+    int64_t start_buffer_duration_; // ns
+    // events received before the start, ring of START_BUFFER_SIZE allocated
+    // on the first packet and released once replayed
+    vector<Event> start_buffer_;
+    size_t start_head_, start_size_;
+    // replay start_buffer_ from the event time of the start pose at the next batch
+    bool replay_pending_;
+    int64_t replay_from_;
+    vector<Event> replay_batch_;
+    void bufferEvents(const vector<Event>& events);
+    // track the buffered events between replay_from_ and before
+    void replayBuffer(int64_t before);
+
+    // TRACKING QUALITY
+    TrackingMonitor monitor_;
+    // reset automatically from a new camera pose when the filter diverges
+    bool auto_reset_;
+    // diverged, waiting for a camera pose newer than diverged_ts_
+    bool waiting_fresh_pose_;
+    int64_t diverged_ts_;
+
+    // IDLE MODE
+    // still camera detection, null if disabled
+    std::unique_ptr<IdleDetector> idle_;
+    // time of the last event of the previous batch, for the event rate
+    int64_t last_batch_ts_;
+    // stop the filter at its current pose
+    void freeze();
+    // sample the events of a packet while idle, true if the camera moves again
+    bool checkIdle(const vector<Event>& events, double rate);
+
+    // RELOCALIZATION
+    // workers for parallel work
+    std::shared_ptr<ThreadPool> pool_;
+    // event-only relocalization while waiting for a fresh pose, null if disabled
+    std::unique_ptr<Relocalizer> relocalizer_;
+    // last state of a good monitor window, guess of the relocalization
+    bool has_good_state_;
+    EFK::State last_good_state_;
+    int64_t last_relocalization_ts_;
+    // search the pose around last_good_state_ and reset from it if found
+    bool relocalize(int64_t ts);
+
+    // MULTI HYPOTHESIS
+    // filters with other noise settings fed with the associated events, null if disabled
+    std::unique_ptr<MultiHypothesis> hypotheses_;
+    // associated events of the current batch
+    vector<MultiHypothesis::Measurement> measurements_;
+    // time since the last associated event
+    double measurement_dt_;
+    void handleEvent(const Event &e);
+
+    // SMOOTHING
+    // sliding window refinement of the filter, null if disabled
+    std::unique_ptr<FixedLagSmoother> smoother_;
+    // associated events of the current batch
+    vector<FixedLagSmoother::Measurement> smoother_measurements_;
+
+    // UNDISTORT EVENTS
+    Vec3 undist_coeffs;
+
+    // INSTRUMENTATION
+    TrackerStats stats_;
+    // the stages of the current event are timed
+    bool time_event_;
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
-#include <ros/ros.h>
+#include "log.h"
 #include <vector>
+#include <string>
 #include <cmath>
 #include <Eigen/Dense>
 #include <Eigen/Geometry> 
@@ -25,6 +26,18 @@ class TrackerMap {
 // Store and keep track of a 3d map of segments
     public:
         TrackerMap();
+        explicit TrackerMap(const vector<SlamLine>& segments);
+
+        // read segments from a text file, one "x1 y1 z1 x2 y2 z2" per line
+        // empty lines and lines starting with # are ignored
+        static bool loadSegments(const std::string& path, vector<SlamLine>& segments);
+
+        inline int size() const { return map_.size(); }
+        // copy of the 3d segments without their projections, safe to call
+        // while another thread projects since 3d points are never modified
+        vector<SlamLine> copySegments() const;
+        // true once projectAll has been called
+        inline bool isProjected() const { return is_projected_; }
         
         // project all 3d segment to the 2d map
         void projectAll(const Vec3& camera_position,
@@ -38,6 +51,8 @@ class TrackerMap {
             const Quaternion& camera_orientation,
             const Vec4& camera_matrix);
 
+        inline const SlamLine& getSegment(int s_id) const { return map_[s_id]; }
+
         // get distance of a point to a segment in the 2d map
         inline double getDistance(const Point2d &p, int s_id) {
             return SlamLine::getDistance(map_[s_id], p);
@@ -57,6 +72,7 @@ class TrackerMap {
 
     private:
         vector<SlamLine> map_; // SlamLine: 3D lines and their 2D projections // TODO make map<SlamLine>.
+        bool is_projected_;
 
         cv::RotatedRect getErrorEllipse(double chisq, const Point2d &mean, const Eigen::Matrix2d& cov);
 };
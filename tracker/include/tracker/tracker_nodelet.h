@@ -1,5 +1,6 @@
 #pragma once
 #include <nodelet/nodelet.h>
+#include <memory>
 #include "tracker/tracker.h"
 
 namespace track
@@ -10,7 +11,7 @@ public:
     virtual void onInit();
 
 private:
-    track::Tracker* tracker;
+    std::unique_ptr<track::Tracker> tracker;
 };
 
 }
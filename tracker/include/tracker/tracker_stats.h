@@ -0,0 +1,130 @@
+#pragma once
+#include <cstdint>
+#include <chrono>
+#include <ostream>
+
+namespace track
+{
+
+class LatencyHistogram {
+// Durations in ns, HDR style: each power of 2 is cut in 16 buckets, so any
+// value is known within 1/16 from 1 ns to 78 hours. Recording is a few
+// integer instructions, the memory is fixed.
+public:
+    LatencyHistogram();
+
+    inline void record(uint64_t ns) {
+        ++counts_[index(ns)];
+        ++count_;
+        sum_ += ns;
+        if (ns < min_) min_ = ns;
+        if (ns > max_) max_ = ns;
+    }
+    void merge(const LatencyHistogram& other);
+    void clear();
+
+    inline uint64_t count() const { return count_; }
+    // ns, 0 if empty
+    inline uint64_t min() const { return count_ ? min_ : 0; }
+    inline uint64_t max() const { return max_; }
+    inline double mean() const { return count_ ? double(sum_)/count_ : 0; }
+    // upper bound (ns) of the bucket holding the p quantile, p in [0, 1]
+    uint64_t percentile(double p) const;
+
+private:
+    static const int SUB_BITS = 4;
+    static const int SUB_BUCKETS = 1 << SUB_BITS;
+    static const int MAX_BITS = 48;
+    static const int BUCKETS = (MAX_BITS - SUB_BITS + 1)*SUB_BUCKETS;
+    uint64_t counts_[BUCKETS];
+    uint64_t count_, sum_, min_, max_;
+
+    static inline int index(uint64_t ns) {
+        if (ns < SUB_BUCKETS) return int(ns);
+        int bits = 63 - __builtin_clzll(ns);
+        if (bits >= MAX_BITS) return BUCKETS - 1;
+        return (bits - SUB_BITS + 1)*SUB_BUCKETS + int((ns >> (bits - SUB_BITS)) & (SUB_BUCKETS - 1));
+    }
+    static uint64_t upperBound(int index);
+};
+
+class TrackerStats {
+// Timings of the stages of the event path and event counters. Stages that
+// run per event are timed on one event every few (see Timer), the counters
+// see every event. Not thread safe, written by the thread tracking.
+public:
+    enum Stage {
+        Conversion,    // message to batch of events
+        Undistortion,
+        Predict,
+        Association,   // nearest segment
+        Project,       // reprojection of the associated segment
+        Update,        // distance, jacobians and filter update
+        Publish,       // pose message
+        Visualization, // map and events image
+        Packet,        // a whole batch in the core
+        EndToEnd,      // event timestamp to pose published
+        STAGES
+    };
+    enum Counter {
+        Received,      // events of the packets
+        Subsampled,    // events skipped to keep batches small
+        Dropped,       // events of packets dropped by a full backlog
+        Matched,       // events associated to a segment
+        Rejected,      // events far from every segment or ambiguous
+        Idle,          // events of packets received while the camera is still
+        COUNTERS
+    };
+    static const char* stageName(Stage stage);
+    static const char* counterName(Counter counter);
+
+    using Clock = std::chrono::steady_clock;
+
+    class Timer {
+    // records the duration of its scope, does nothing when not enabled
+    public:
+        inline Timer(TrackerStats& stats, Stage stage, bool enabled = true) :
+            stats_(enabled ? &stats : nullptr), stage_(stage) {
+            if (stats_) start_ = Clock::now();
+        }
+        inline ~Timer() {
+            if (stats_) stats_->record(stage_, Clock::now() - start_);
+        }
+    private:
+        TrackerStats* stats_;
+        Stage stage_;
+        Clock::time_point start_;
+    };
+
+    // per event stages timed on one event every sampling, 0 disables them
+    explicit TrackerStats(unsigned sampling = 16);
+
+    // true if the per event stages of the next event are timed
+    inline bool sample() {
+        if (sampling_ == 0) return false;
+        if (++sample_counter_ < sampling_) return false;
+        sample_counter_ = 0;
+        return true;
+    }
+    inline void record(Stage stage, Clock::duration duration) {
+        stages_[stage].record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+    inline void record(Stage stage, uint64_t ns) { stages_[stage].record(ns); }
+    inline void add(Counter counter, uint64_t n = 1) { counters_[counter] += n; }
+
+    inline const LatencyHistogram& get(Stage stage) const { return stages_[stage]; }
+    inline uint64_t get(Counter counter) const { return counters_[counter]; }
+
+    void merge(const TrackerStats& other);
+    // counters and histograms, the sampling is kept
+    void clear();
+    // a table of the counters and of the stages, times in us
+    void report(std::ostream& out) const;
+
+private:
+    unsigned sampling_, sample_counter_;
+    LatencyHistogram stages_[STAGES];
+    uint64_t counters_[COUNTERS];
+};
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <Eigen/Dense>
+#include <cmath>
+#include "efk.h"
+
+namespace track
+{
+
+class TrackingMonitor {
+// Online health of the filter, computed over windows of events:
+// association ratio, mean normalized innovation squared (NIS, ~1 when the
+// filter is consistent) and trace of the pose covariance
+public:
+    struct Params {
+        uint window_events           = 2000; // events per evaluation window
+        double min_association_ratio = 0.1;  // matched / seen events
+        double max_mean_nis          = 25;   // mean z^2/Z of the updates
+        uint max_bad_windows         = 3;    // consecutive bad windows before divergence
+        double max_position_trace    = 3*50*50; // mm^2, trace of P_rr
+        double max_orientation_trace = 0.1;  // trace of P_qq
+    };
+    struct Health {
+        double association_ratio;
+        double mean_nis;
+        double position_trace;
+        double orientation_trace;
+    };
+
+    TrackingMonitor();
+    explicit TrackingMonitor(const Params& params);
+
+    // start again after a filter reset
+    void reset();
+    // one event went through association
+    inline void addEvent(bool matched) {
+        ++events_;
+        if (matched) ++matched_;
+    }
+    // normalized innovation squared of an update
+    inline void addInnovation(double nis) {
+        nis_sum_ += nis;
+        ++updates_;
+    }
+    // evaluate the metrics, true if the filter diverged
+    bool check(const EFK::State& X, const Mat13& P);
+
+    // true if the last evaluated window was good
+    inline bool isGood() const { return bad_windows_ == 0; }
+    // metrics of the last evaluated window
+    inline const Health& getHealth() const { return health_; }
+
+private:
+    Params params_;
+    Health health_;
+    uint events_;
+    uint matched_;
+    uint updates_;
+    double nis_sum_;
+    uint bad_windows_;
+};
+
+} // namespace
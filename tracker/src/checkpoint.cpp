@@ -0,0 +1,98 @@
+#include "tracker/checkpoint.h"
+#include <fstream>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+
+namespace track
+{
+
+namespace {
+
+const char MAGIC[8] = {'T', 'R', 'K', 'C', 'K', 'P', '0', '1'};
+// magic, stamps, state, covariance, camera matrix, distortion count
+const std::size_t FIXED_SIZE = 8 + 2*8 + (13 + 169 + 4)*8 + 4;
+
+inline void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(v >> 8*i));
+}
+inline void putU64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(uint8_t(v >> 8*i));
+}
+inline void putF64(std::vector<uint8_t>& out, double d) {
+    uint64_t v;
+    std::memcpy(&v, &d, 8);
+    putU64(out, v);
+}
+inline uint32_t getU32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= uint32_t(p[i]) << 8*i;
+    return v;
+}
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= uint64_t(p[i]) << 8*i;
+    return v;
+}
+inline double getF64(const uint8_t* p) {
+    uint64_t v = getU64(p);
+    double d;
+    std::memcpy(&d, &v, 8);
+    return d;
+}
+
+}
+
+bool writeCheckpoint(const std::string& path, const Checkpoint& c) {
+    std::vector<uint8_t> data(MAGIC, MAGIC + 8);
+    data.reserve(FIXED_SIZE + 8*c.D.size());
+    putU64(data, c.written);
+    putU64(data, c.last_event_ts);
+    Vec3 w = c.X.w.angle()*c.X.w.axis();
+    const double x[13] = { c.X.r[0], c.X.r[1], c.X.r[2], c.X.q.w(), c.X.q.x(), c.X.q.y(), c.X.q.z(),
+                           c.X.v[0], c.X.v[1], c.X.v[2], w[0], w[1], w[2] };
+    for (double d : x) putF64(data, d);
+    for (int i = 0; i < 13; ++i)
+        for (int j = 0; j < 13; ++j) putF64(data, c.P(i, j));
+    for (int i = 0; i < 4; ++i) putF64(data, c.K[i]);
+    putU32(data, c.D.size());
+    for (double d : c.D) putF64(data, d);
+
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(data.data()), data.size());
+        if (!file) return false;
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool readCheckpoint(const std::string& path, Checkpoint& c) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < FIXED_SIZE or std::memcmp(data.data(), MAGIC, 8) != 0) return false;
+    const uint8_t* p = data.data() + 8;
+    c.written = getU64(p);
+    c.last_event_ts = getU64(p + 8);
+    p += 16;
+    double x[13];
+    for (int i = 0; i < 13; ++i, p += 8) x[i] = getF64(p);
+    c.X.r = Vec3(x[0], x[1], x[2]);
+    c.X.q = Quaternion(x[3], x[4], x[5], x[6]);
+    c.X.v = Vec3(x[7], x[8], x[9]);
+    Vec3 w(x[10], x[11], x[12]);
+    double angle = w.norm();
+    c.X.w = angle > 0 ? AngleAxis(angle, w/angle) : AngleAxis(0, Vec3::UnitZ());
+    for (int i = 0; i < 13; ++i)
+        for (int j = 0; j < 13; ++j, p += 8) c.P(i, j) = getF64(p);
+    for (int i = 0; i < 4; ++i, p += 8) c.K[i] = getF64(p);
+    uint32_t n = getU32(p);
+    p += 4;
+    if (data.size() != FIXED_SIZE + 8*std::size_t(n)) return false;
+    c.D.resize(n);
+    for (uint32_t i = 0; i < n; ++i, p += 8) c.D[i] = getF64(p);
+    return true;
+}
+
+} // namespace
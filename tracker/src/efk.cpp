@@ -7,9 +7,7 @@ EFK::EFK() {}
 
 EFK::EFK(const Vec3& sigma_v, const Vec3& sigma_w, double sigma_d) {
     P_ = Mat13::Zero();
-    Q_ = Mat13::Zero();
-    Q_.diagonal() << 0,0,0 , 0,0,0,0, sigma_v.cwiseAbs2(), sigma_w.cwiseAbs2();
-    R_ = sigma_d*sigma_d;
+    setNoise(sigma_v, sigma_w, sigma_d);
 }
 
 void EFK::init(const State& X0, const Mat13& P0) {
@@ -17,6 +15,12 @@ void EFK::init(const State& X0, const Mat13& P0) {
     P_ = P0;
 }
 
+void EFK::setNoise(const Vec3& sigma_v, const Vec3& sigma_w, double sigma_d) {
+    Q_ = Mat13::Zero();
+    Q_.diagonal() << 0,0,0 , 0,0,0,0, sigma_v.cwiseAbs2(), sigma_w.cwiseAbs2();
+    R_ = sigma_d*sigma_d;
+}
+
 void EFK::predict(double dt) {
     /* constant velocity model
         r = r + v * dt
@@ -95,7 +99,7 @@ void EFK::predict(double dt) {
     */
 }
 
-void EFK::update(double dist, const Eigen::Matrix<double, 1, 7>& H) {
+double EFK::update(double dist, const Eigen::Matrix<double, 1, 7>& H) {
     double z = -dist; // expected distance is 0
     // real H = [H_r, H_q, H_v, H_w] = [H_r, H_q, 0, 0]
     double Z = H * P_.block<7,7>(0,0) * H.transpose() + R_;
@@ -116,11 +120,14 @@ void EFK::update(double dist, const Eigen::Matrix<double, 1, 7>& H) {
     Vec3 new_angle_axis = X_.w.angle()*X_.w.axis() + K.block<3,1>(10,0)*z;
     double new_angle    = new_angle_axis.norm();
     X_.w.angle()        = new_angle;
-    X_.w.axis()         = new_angle_axis / new_angle;
+    // no rotation (first update after a reset), any axis is right
+    if (new_angle > 0) X_.w.axis() = new_angle_axis / new_angle;
 
     // update state covariance      P = P - K * Z * K'
     // noalias for faster operation (lhs and rhs do not alias)
     P_.noalias() -= K * Z * K.transpose();
+
+    return z*z/Z;
 }
 
 EFK::State EFK::getState() {
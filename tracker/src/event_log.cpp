@@ -0,0 +1,268 @@
+#include "tracker/event_log.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace track
+{
+
+namespace {
+
+const char HEADER_MAGIC[8] = {'E', 'V', 'T', 'L', 'O', 'G', '0', '1'};
+const char FOOTER_MAGIC[8] = {'E', 'V', 'T', 'I', 'D', 'X', '0', '1'};
+const std::size_t HEADER_SIZE = 16;
+const std::size_t CHUNK_HEADER_SIZE = 32;
+const std::size_t INDEX_ENTRY_SIZE = 40;
+const std::size_t FOOTER_SIZE = 24;
+
+inline void putU32(std::vector<uint8_t>& out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) out.push_back(uint8_t(v >> 8*i));
+}
+inline void putU64(std::vector<uint8_t>& out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) out.push_back(uint8_t(v >> 8*i));
+}
+inline uint32_t getU32(const uint8_t* p) {
+    uint32_t v = 0;
+    for (int i = 0; i < 4; ++i) v |= uint32_t(p[i]) << 8*i;
+    return v;
+}
+inline uint64_t getU64(const uint8_t* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v |= uint64_t(p[i]) << 8*i;
+    return v;
+}
+
+}
+
+EventLogWriter::EventLogWriter(uint32_t chunk_events) :
+    chunk_events_(std::max(1u, chunk_events)) {}
+
+EventLogWriter::~EventLogWriter() {
+    close();
+}
+
+bool EventLogWriter::open(const std::string& path, uint32_t width, uint32_t height) {
+    close();
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    if (!file_) return false;
+    std::vector<uint8_t> header(HEADER_MAGIC, HEADER_MAGIC + 8);
+    putU32(header, width);
+    putU32(header, height);
+    file_.write(reinterpret_cast<const char*>(header.data()), header.size());
+    events_.reserve(chunk_events_);
+    return bool(file_);
+}
+
+void EventLogWriter::add(const PackedEvent& e) {
+    events_.push_back(e);
+    if (events_.size() >= chunk_events_) writeChunk();
+}
+
+void EventLogWriter::writeChunk() {
+    if (events_.empty()) return;
+    // microseconds unless some timestamp needs more
+    uint32_t unit = 1000;
+    for (const PackedEvent& e : events_)
+        if (EventEncoder::unitFor(e.t) != 1000) {
+            unit = 1;
+            break;
+        }
+    EventLogChunk chunk;
+    chunk.t_first = events_.front().t;
+    chunk.t_last = events_.back().t;
+    chunk.count = events_.size();
+    chunk.dt_unit = unit;
+
+    data_.clear();
+    putU64(data_, chunk.t_first);
+    putU64(data_, chunk.t_last);
+    std::size_t size_pos = data_.size();
+    putU64(data_, 0);
+    putU32(data_, chunk.count);
+    putU32(data_, chunk.dt_unit);
+    EventEncoder encoder(data_, chunk.t_first, unit);
+    for (const PackedEvent& e : events_)
+        encoder.add(e.x, e.y, e.polarity, e.t);
+    chunk.size = data_.size() - CHUNK_HEADER_SIZE;
+    for (int i = 0; i < 8; ++i) data_[size_pos + i] = uint8_t(chunk.size >> 8*i);
+
+    chunk.offset = uint64_t(file_.tellp()) + CHUNK_HEADER_SIZE;
+    file_.write(reinterpret_cast<const char*>(data_.data()), data_.size());
+    file_.flush(); // complete chunks survive a recorder that never closes
+    index_.push_back(chunk);
+    events_.clear();
+}
+
+bool EventLogWriter::close() {
+    if (!file_.is_open()) return true;
+    writeChunk();
+    uint64_t index_offset = file_.tellp();
+    data_.clear();
+    for (const EventLogChunk& chunk : index_) {
+        putU64(data_, chunk.t_first);
+        putU64(data_, chunk.t_last);
+        putU64(data_, chunk.offset);
+        putU64(data_, chunk.size);
+        putU32(data_, chunk.count);
+        putU32(data_, chunk.dt_unit);
+    }
+    putU64(data_, index_offset);
+    putU64(data_, index_.size());
+    data_.insert(data_.end(), FOOTER_MAGIC, FOOTER_MAGIC + 8);
+    file_.write(reinterpret_cast<const char*>(data_.data()), data_.size());
+    bool ok = bool(file_);
+    file_.close();
+    index_.clear();
+    return ok;
+}
+
+
+EventLogReader::EventLogReader() :
+    data_(nullptr), size_(0), width_(0), height_(0), chunk_(0),
+    decoder_(nullptr, 0, 0, 1), has_pending_(false) {}
+
+EventLogReader::~EventLogReader() {
+    close();
+}
+
+bool EventLogReader::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0 or std::size_t(st.st_size) < HEADER_SIZE) {
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping stays valid
+    if (data == MAP_FAILED) return false;
+    data_ = static_cast<const uint8_t*>(data);
+    size_ = st.st_size;
+    if (std::memcmp(data_, HEADER_MAGIC, 8) != 0) {
+        close();
+        return false;
+    }
+    width_ = getU32(data_ + 8);
+    height_ = getU32(data_ + 12);
+    // a recorder that did not close the log (killed, crashed...) leaves
+    // complete chunks without index
+    if (!readIndex()) rebuildIndex();
+    startChunk(0);
+    return true;
+}
+
+bool EventLogReader::readIndex() {
+    // validate footer and index before trusting any offset
+    if (size_ < HEADER_SIZE + FOOTER_SIZE) return false;
+    const uint8_t* footer = data_ + size_ - FOOTER_SIZE;
+    uint64_t index_offset = getU64(footer);
+    uint64_t chunks = getU64(footer + 8);
+    if (std::memcmp(footer + 16, FOOTER_MAGIC, 8) != 0 or
+        index_offset < HEADER_SIZE or index_offset > size_ - FOOTER_SIZE or
+        chunks != (size_ - FOOTER_SIZE - index_offset) / INDEX_ENTRY_SIZE) return false;
+    index_.resize(chunks);
+    for (std::size_t i = 0; i < chunks; ++i) {
+        const uint8_t* p = data_ + index_offset + i*INDEX_ENTRY_SIZE;
+        EventLogChunk& chunk = index_[i];
+        chunk.t_first = getU64(p);
+        chunk.t_last = getU64(p + 8);
+        chunk.offset = getU64(p + 16);
+        chunk.size = getU64(p + 24);
+        chunk.count = getU32(p + 32);
+        chunk.dt_unit = std::max(1u, getU32(p + 36));
+        if (chunk.offset > index_offset or chunk.size > index_offset - chunk.offset) {
+            index_.clear();
+            return false;
+        }
+    }
+    return true;
+}
+
+void EventLogReader::rebuildIndex() {
+    // walk the chunk headers up to the first truncated chunk
+    index_.clear();
+    std::size_t offset = HEADER_SIZE;
+    while (size_ - offset >= CHUNK_HEADER_SIZE) {
+        const uint8_t* p = data_ + offset;
+        EventLogChunk chunk;
+        chunk.t_first = getU64(p);
+        chunk.t_last = getU64(p + 8);
+        chunk.offset = offset + CHUNK_HEADER_SIZE;
+        chunk.size = getU64(p + 16);
+        chunk.count = getU32(p + 24);
+        chunk.dt_unit = std::max(1u, getU32(p + 28));
+        if (chunk.size > size_ - chunk.offset or chunk.t_last < chunk.t_first or
+            (!index_.empty() and chunk.t_first < index_.back().t_last)) break;
+        index_.push_back(chunk);
+        offset = chunk.offset + chunk.size;
+    }
+}
+
+void EventLogReader::close() {
+    if (data_) munmap(const_cast<uint8_t*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+    chunk_ = 0;
+    decoder_ = EventDecoder(nullptr, 0, 0, 1);
+    has_pending_ = false;
+}
+
+uint64_t EventLogReader::size() const {
+    uint64_t events = 0;
+    for (const EventLogChunk& chunk : index_) events += chunk.count;
+    return events;
+}
+
+uint64_t EventLogReader::beginTime() const {
+    return index_.empty() ? 0 : index_.front().t_first;
+}
+
+uint64_t EventLogReader::endTime() const {
+    return index_.empty() ? 0 : index_.back().t_last;
+}
+
+void EventLogReader::startChunk(std::size_t chunk) {
+    chunk_ = chunk;
+    has_pending_ = false;
+    if (chunk_ >= index_.size()) {
+        decoder_ = EventDecoder(nullptr, 0, 0, 1);
+        return;
+    }
+    const EventLogChunk& c = index_[chunk_];
+    decoder_ = EventDecoder(data_ + c.offset, c.size, c.t_first, c.dt_unit);
+}
+
+void EventLogReader::seek(uint64_t t) {
+    // first chunk ending at or after t
+    std::vector<EventLogChunk>::const_iterator it = std::lower_bound(index_.begin(), index_.end(), t,
+        [](const EventLogChunk& chunk, uint64_t t) { return chunk.t_last < t; });
+    startChunk(it - index_.begin());
+    PackedEvent e;
+    while (next(e)) {
+        if (e.t >= t) {
+            pending_ = e;
+            has_pending_ = true;
+            return;
+        }
+    }
+}
+
+bool EventLogReader::next(PackedEvent& e) {
+    if (has_pending_) {
+        e = pending_;
+        has_pending_ = false;
+        return true;
+    }
+    while (chunk_ < index_.size()) {
+        if (decoder_.next(e)) return true;
+        startChunk(chunk_ + 1);
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,39 @@
+#include <ros/ros.h>
+#include <dvs_msgs/EventArray.h>
+#include <tracker/PackedEventArray.h>
+#include "tracker/event_codec.h"
+
+// Republishes dvs_msgs/EventArray as tracker/PackedEventArray, to run next
+// to the camera driver so that only packed events cross the network
+int main(int argc, char* argv[]) {
+  ros::init(argc, argv, "event_packer");
+
+  ros::NodeHandle nh;
+  ros::Publisher packed_pub = nh.advertise<tracker::PackedEventArray>("packed_events", 10);
+  ros::Subscriber events_sub = nh.subscribe<dvs_msgs::EventArray>("events", 10,
+    [&packed_pub](const dvs_msgs::EventArray::ConstPtr& msg) {
+      if (msg->events.empty() or packed_pub.getNumSubscribers() == 0) return;
+      tracker::PackedEventArray::Ptr packed(new tracker::PackedEventArray);
+      packed->header = msg->header;
+      packed->height = msg->height;
+      packed->width = msg->width;
+      packed->t0 = msg->events.front().ts;
+      // microseconds unless some timestamp needs more
+      packed->dt_unit = 1000;
+      for (const dvs_msgs::Event& e : msg->events)
+        if (track::EventEncoder::unitFor(e.ts.toNSec()) != 1000) {
+          packed->dt_unit = 1;
+          break;
+        }
+      packed->count = msg->events.size();
+      packed->data.reserve(msg->events.size() * 5);
+      track::EventEncoder encoder(packed->data, packed->t0.toNSec(), packed->dt_unit);
+      for (const dvs_msgs::Event& e : msg->events)
+        encoder.add(e.x, e.y, e.polarity, e.ts.toNSec());
+      packed_pub.publish(packed);
+    }, ros::VoidConstPtr(), ros::TransportHints().tcpNoDelay());
+  ROS_INFO("started event packer");
+  ros::spin();
+
+  return 0;
+}
@@ -0,0 +1,50 @@
+#include <ros/ros.h>
+#include <dvs_msgs/EventArray.h>
+#include <tracker/PackedEventArray.h>
+#include "tracker/event_log.h"
+
+// Records events (dvs_msgs or packed) to an event log, see event_log.h
+//   ~file [string, events.evlog], ~chunk_events [int, 50000]
+int main(int argc, char* argv[]) {
+  ros::init(argc, argv, "event_recorder");
+
+  ros::NodeHandle nh;
+  ros::NodeHandle pnh("~");
+  std::string file;
+  pnh.param<std::string>("file", file, "events.evlog");
+  int chunk_events;
+  pnh.param("chunk_events", chunk_events, 50000);
+  track::EventLogWriter writer(std::max(1, chunk_events));
+  // the log is opened with the size of the first packet
+  auto open = [&](uint32_t width, uint32_t height) {
+    if (writer.isOpen()) return true;
+    if (!writer.open(file, width, height)) {
+      ROS_ERROR_STREAM_THROTTLE(5, "cannot write event log " << file);
+      return false;
+    }
+    ROS_INFO_STREAM("recording events to " << file);
+    return true;
+  };
+
+  ros::Subscriber events_sub = nh.subscribe<dvs_msgs::EventArray>("events", 100,
+    [&](const dvs_msgs::EventArray::ConstPtr& msg) {
+      if (!open(msg->width, msg->height)) return;
+      for (const dvs_msgs::Event& e : msg->events)
+        writer.add(track::PackedEvent { e.x, e.y, e.polarity, e.ts.toNSec() });
+    });
+  ros::Subscriber packed_events_sub = nh.subscribe<tracker::PackedEventArray>("packed_events", 100,
+    [&](const tracker::PackedEventArray::ConstPtr& msg) {
+      if (!open(msg->width, msg->height)) return;
+      track::EventDecoder decoder(msg->data.data(), msg->data.size(), msg->t0.toNSec(),
+                                  std::max(1u, msg->dt_unit));
+      track::PackedEvent e;
+      while (decoder.next(e)) writer.add(e);
+    });
+  ros::spin();
+
+  if (writer.isOpen() and !writer.close()) {
+    ROS_ERROR_STREAM("error writing event log " << file);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "tracker/event_simulator.h"
+#include <cmath>
+#include <algorithm>
+
+namespace track
+{
+
+EventSimulator::EventSimulator(const Params& params, const vector<SlamLine>& segments) :
+    params_(params), segments_(segments), carry_(0) {
+    // splitmix64 of the seed as state
+    uint64_t z = params.seed;
+    for (uint64_t& s : state_) {
+        z += 0x9e3779b97f4a7c15ull;
+        uint64_t x = z;
+        x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27))*0x94d049bb133111ebull;
+        s = x ^ (x >> 31);
+    }
+    for (size_t i = 0; i < segments_.size(); ++i) contrast_.push_back(uniform() < 0.5);
+}
+
+void EventSimulator::getPose(uint64_t t, Vec3& r, Quaternion& q) const {
+    double s = (int64_t(t) - int64_t(params_.start_time))*1e-9;
+    Vec3 phase = 2*M_PI*s*params_.position_frequency;
+    r = params_.position + params_.position_amplitude.cwiseProduct(
+        Vec3(std::sin(phase[0]), std::sin(phase[1]), std::sin(phase[2])));
+    Vec3 angle_phase = 2*M_PI*s*params_.rotation_frequency;
+    Vec3 angles = params_.rotation_amplitude.cwiseProduct(
+        Vec3(std::sin(angle_phase[0]), std::sin(angle_phase[1]), std::sin(angle_phase[2])));
+    q = params_.orientation *
+        Eigen::AngleAxisd(angles[0], Vec3::UnitX()) *
+        Eigen::AngleAxisd(angles[1], Vec3::UnitY()) *
+        Eigen::AngleAxisd(angles[2], Vec3::UnitZ());
+    q.normalize();
+}
+
+bool EventSimulator::project(const Point3d& p, const Vec3& r, const Quaternion& q, Point2d& pixel) const {
+    // same model as SlamLine::project
+    Point3d pc = q.conjugate() * (p - r);
+    if (pc[2] < 1) return false;
+    const Vec4& K = params_.K;
+    pixel << K[2]*pc[0]/pc[2] + K[0], K[3]*pc[1]/pc[2] + K[1];
+    return true;
+}
+
+void EventSimulator::generate(uint64_t t0, uint64_t t1, vector<PackedEvent>& events) {
+    if (t1 <= t0) return;
+    double duration = (t1 - t0)*1e-9;
+    double expected = params_.rate*duration + carry_;
+    uint n = uint(expected);
+    carry_ = expected - n;
+    if (n == 0) return;
+
+    // segments and their image velocity at the middle of the interval, the
+    // motion during one call (a packet) is assumed linear
+    const uint64_t tm = t0 + (t1 - t0)/2;
+    const double h = 1e-3;
+    Vec3 r, r_h;
+    Quaternion q, q_h;
+    getPose(tm, r, q);
+    getPose(tm + uint64_t(h*1e9), r_h, q_h);
+    size_t segments = segments_.size();
+    p1_.resize(segments); p2_.resize(segments);
+    v1_.resize(segments); v2_.resize(segments);
+    weights_.assign(segments, 0);
+    double total_weight = 0;
+    for (size_t i = 0; i < segments; ++i) {
+        Point2d p1_h, p2_h;
+        if (!(project(segments_[i].p1_3d, r, q, p1_[i]) and project(segments_[i].p2_3d, r, q, p2_[i]) and
+              project(segments_[i].p1_3d, r_h, q_h, p1_h) and project(segments_[i].p2_3d, r_h, q_h, p2_h)))
+            continue;
+        v1_[i] = (p1_h - p1_[i])/h;
+        v2_[i] = (p2_h - p2_[i])/h;
+        // events per second of an edge ~ swept area: length * normal speed
+        Vec2 d = p2_[i] - p1_[i];
+        double length = d.norm();
+        if (length < 1e-6) continue;
+        Vec2 normal(-d[1]/length, d[0]/length);
+        weights_[i] = length*0.5*(std::abs(normal.dot(v1_[i])) + std::abs(normal.dot(v2_[i])));
+        total_weight += weights_[i];
+    }
+
+    // cumulative weights to pick the segment of an event
+    for (size_t i = 1; i < segments; ++i) weights_[i] += weights_[i - 1];
+    double noise_ratio = total_weight > 0 ? params_.noise_ratio : 1;
+    for (uint i = 0; i < n; ++i) {
+        // evenly spread timestamps with jitter, still in order
+        uint64_t t = t0 + uint64_t((i + uniform())/n*(t1 - t0));
+        PackedEvent e;
+        e.t = t;
+        if (uniform() < noise_ratio) {
+            e.x = std::min(params_.width - 1, uint(uniform()*params_.width));
+            e.y = std::min(params_.height - 1, uint(uniform()*params_.height));
+            e.polarity = uniform() < 0.5;
+            events.push_back(e);
+            continue;
+        }
+        size_t s = std::upper_bound(weights_.begin(), weights_.end(), uniform()*total_weight) - weights_.begin();
+        s = std::min(s, segments - 1);
+        double a = uniform();
+        double dt = (int64_t(t) - int64_t(tm))*1e-9;
+        Point2d velocity = (1 - a)*v1_[s] + a*v2_[s];
+        Point2d p = (1 - a)*p1_[s] + a*p2_[s] + velocity*dt;
+        // close to gaussian (sum of 4 uniforms), much cheaper than Box-Muller
+        const double scale = params_.position_sigma*std::sqrt(3.0);
+        p[0] += scale*(uniform() + uniform() + uniform() + uniform() - 2);
+        p[1] += scale*(uniform() + uniform() + uniform() + uniform() - 2);
+        double x = std::round(p[0]), y = std::round(p[1]);
+        if (x < 0 or y < 0 or x >= params_.width or y >= params_.height) continue;
+        e.x = uint16_t(x);
+        e.y = uint16_t(y);
+        Vec2 d = p2_[s] - p1_[s];
+        bool forward = Vec2(-d[1], d[0]).dot(velocity) > 0;
+        e.polarity = (forward != contrast_[s]) != (uniform() < params_.polarity_flip);
+        events.push_back(e);
+    }
+}
+
+}
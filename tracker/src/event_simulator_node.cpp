@@ -0,0 +1,111 @@
+#include <ros/ros.h>
+#include <dvs_msgs/EventArray.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <geometry_msgs/PoseStamped.h>
+#include "tracker/event_simulator.h"
+#include "tracker/shared_map.h"
+
+// Stand-in for davis_ros_driver and track_init: publishes simulated events
+// of a camera moving in front of a map, its calibration and poses
+int main(int argc, char* argv[]) {
+  ros::init(argc, argv, "event_simulator");
+
+  ros::NodeHandle nh;
+  ros::NodeHandle pnh("~");
+
+  track::EventSimulator::Params params;
+  pnh.param("rate", params.rate, params.rate);
+  pnh.param("noise_ratio", params.noise_ratio, params.noise_ratio);
+  pnh.param("position_sigma", params.position_sigma, params.position_sigma);
+  pnh.param("polarity_flip", params.polarity_flip, params.polarity_flip);
+  int seed;
+  pnh.param("seed", seed, 1);
+  params.seed = seed;
+  // trajectory vectors [x y z]
+  auto vec3Param = [&pnh](const std::string& name, Vec3& v) {
+    std::vector<double> values;
+    if (pnh.getParam(name, values) and values.size() == 3) v = Vec3(values[0], values[1], values[2]);
+  };
+  vec3Param("position", params.position);
+  vec3Param("position_amplitude", params.position_amplitude);
+  vec3Param("position_frequency", params.position_frequency);
+  vec3Param("rotation_amplitude", params.rotation_amplitude);
+  vec3Param("rotation_frequency", params.rotation_frequency);
+  double packet_rate, pose_rate, duration;
+  pnh.param("packet_rate", packet_rate, 1000.0);
+  pnh.param("pose_rate", pose_rate, 10.0);
+  pnh.param("duration", duration, 0.0);
+
+  track::SharedMap map;
+  std::string map_file;
+  if (pnh.getParam("map_file", map_file) and !map.load(map_file)) return 1;
+  params.start_time = ros::Time::now().toNSec();
+  track::EventSimulator simulator(params, *map.getSegments());
+
+  ros::Publisher events_pub = nh.advertise<dvs_msgs::EventArray>("events", 10);
+  ros::Publisher camera_info_pub = nh.advertise<sensor_msgs::CameraInfo>("camera_info", 1, true);
+  ros::Publisher camera_pose_pub = nh.advertise<geometry_msgs::PoseStamped>("camera_pose", 1);
+  ros::Publisher ground_truth_pub = nh.advertise<geometry_msgs::PoseStamped>("ground_truth_pose", 10);
+
+  sensor_msgs::CameraInfo camera_info;
+  camera_info.header.stamp = ros::Time::now();
+  camera_info.width = params.width;
+  camera_info.height = params.height;
+  camera_info.distortion_model = "plumb_bob";
+  camera_info.D = std::vector<double>(5, 0.0);
+  camera_info.K = {params.K[2], 0, params.K[0], 0, params.K[3], params.K[1], 0, 0, 1};
+  camera_info.R = {1, 0, 0, 0, 1, 0, 0, 0, 1};
+  camera_info.P = {params.K[2], 0, params.K[0], 0, 0, params.K[3], params.K[1], 0, 0, 0, 1, 0};
+  camera_info_pub.publish(camera_info);
+
+  auto poseMsg = [&simulator](const ros::Time& stamp) {
+    Vec3 r;
+    Quaternion q;
+    simulator.getPose(stamp.toNSec(), r, q);
+    geometry_msgs::PoseStamped pose;
+    pose.header.frame_id = "map";
+    pose.header.stamp = stamp;
+    pose.pose.position.x = r[0];
+    pose.pose.position.y = r[1];
+    pose.pose.position.z = r[2];
+    pose.pose.orientation.x = q.x();
+    pose.pose.orientation.y = q.y();
+    pose.pose.orientation.z = q.z();
+    pose.pose.orientation.w = q.w();
+    return pose;
+  };
+
+  ROS_INFO_STREAM("simulating " << params.rate*1e-6 << " Mev/s in packets of " << 1e3/packet_rate << " ms");
+  std::vector<track::PackedEvent> events;
+  ros::Time last = ros::Time::now(), last_pose;
+  ros::WallRate rate(packet_rate);
+  while (ros::ok()) {
+    rate.sleep();
+    ros::Time now = ros::Time::now();
+    if (duration > 0 and (now.toNSec() - params.start_time)*1e-9 > duration) break;
+    events.clear();
+    simulator.generate(last.toNSec(), now.toNSec(), events);
+    last = now;
+
+    dvs_msgs::EventArray::Ptr msg(new dvs_msgs::EventArray);
+    msg->header.stamp = now;
+    msg->width = params.width;
+    msg->height = params.height;
+    msg->events.resize(events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+      dvs_msgs::Event& e = msg->events[i];
+      e.x = events[i].x;
+      e.y = events[i].y;
+      e.ts.fromNSec(events[i].t);
+      e.polarity = events[i].polarity;
+    }
+    events_pub.publish(msg);
+    ground_truth_pub.publish(poseMsg(now));
+    if (pose_rate > 0 and (now - last_pose).toSec() >= 1/pose_rate) {
+      camera_pose_pub.publish(poseMsg(now));
+      last_pose = now;
+    }
+  }
+
+  return 0;
+}
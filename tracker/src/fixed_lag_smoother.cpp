@@ -0,0 +1,225 @@
+#include "tracker/fixed_lag_smoother.h"
+#include "tracker/trace.h"
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cmath>
+
+namespace track
+{
+
+namespace {
+
+// exponential of a rotation vector
+inline Quaternion expRotation(const Vec3& theta) {
+    double angle = theta.norm();
+    if (angle < 1e-12) return Quaternion(1, theta[0]/2, theta[1]/2, theta[2]/2).normalized();
+    return Quaternion(AngleAxis(angle, theta/angle));
+}
+
+// rotation vector of a quaternion
+inline Vec3 logRotation(const Quaternion& q) {
+    AngleAxis a(q.w() < 0 ? Quaternion(-q.w(), -q.x(), -q.y(), -q.z()) : q);
+    return a.angle()*a.axis();
+}
+
+// derivative of q . exp(theta) at theta = 0, quaternions in w x y z order
+inline Eigen::Matrix<double, 4, 3> rightJacobian(const Quaternion& q) {
+    Eigen::Matrix<double, 4, 3> G;
+    G << -q.x(), -q.y(), -q.z(),
+          q.w(), -q.z(),  q.y(),
+          q.z(),  q.w(), -q.x(),
+         -q.y(),  q.x(),  q.w();
+    return 0.5*G;
+}
+
+inline Vec3 rotationVector(const AngleAxis& w) {
+    return w.angle()*w.axis();
+}
+
+inline AngleAxis toAngleAxis(const Vec3& w) {
+    double angle = w.norm();
+    return angle > 0 ? AngleAxis(angle, w/angle) : AngleAxis(0, Vec3::UnitZ());
+}
+
+}
+
+FixedLagSmoother::FixedLagSmoother(const Params& params, ThreadPool& pool) :
+    params_(params), pool_(pool), K_(Vec4::Zero()), sigma_d_(1), solving_(false),
+    solve_K_(Vec4::Zero()), solve_sigma_d_(1),
+    cancelled_(false), has_result_(false), result_ts_(0) {
+    params_.max_measurements = std::max(1u, params_.max_measurements);
+    solve_measurements_.reserve(params_.max_measurements);
+}
+
+FixedLagSmoother::~FixedLagSmoother() {
+    // the solve uses the members
+    while (solving_) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void FixedLagSmoother::init(const Vec4& K, double sigma_d) {
+    K_ = K;
+    sigma_d_ = sigma_d;
+    packets_.clear();
+    measurements_.clear();
+    // a running solve is about the previous filter
+    std::lock_guard<std::mutex> lock(result_mutex_);
+    has_result_ = false;
+    cancelled_ = true;
+}
+
+void FixedLagSmoother::process(const EFK::State& X0, const Mat13& P0, int64_t ts0,
+                               vector<Measurement>& measurements, int64_t ts) {
+    if (measurements.empty()) return;
+    measurements_.insert(measurements_.end(), measurements.begin(), measurements.end());
+    measurements.clear();
+    packets_.push_back(Packet { X0, P0, ts0, measurements_.size() });
+
+    // drop the packets older than the window, keeping at least one
+    size_t first = 0;
+    while (first + 1 < packets_.size() and packets_[first + 1].ts0 <= ts - int64_t(params_.window*1e9))
+        ++first;
+    if (first > 0) {
+        size_t begin = packets_[first - 1].end;
+        measurements_.erase(measurements_.begin(), measurements_.begin() + begin);
+        packets_.erase(packets_.begin(), packets_.begin() + first);
+        for (Packet& p : packets_) p.end -= begin;
+    }
+
+    if (solving_) return;
+    {
+        // the filter X does not include that result yet
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        if (has_result_) return;
+        cancelled_ = false;
+    }
+    // copy the window, sampled, and solve it in the pool
+    const Packet& oldest = packets_.front();
+    solve_K_ = K_;
+    solve_sigma_d_ = sigma_d_;
+    solve_X0_ = oldest.X0;
+    solve_information_ = information(oldest.X0, oldest.P0, params_.prior_scale);
+    solve_ts0_ = oldest.ts0;
+    solve_ts_ = ts;
+    solve_measurements_.clear();
+    double step = std::max(1.0, double(measurements_.size())/params_.max_measurements);
+    for (double i = 0; i < measurements_.size(); i += step)
+        solve_measurements_.push_back(measurements_[size_t(i)]);
+    solving_ = true;
+    pool_.enqueue([this] { run(); });
+}
+
+void FixedLagSmoother::run() {
+    TRACK_TRACE_SCOPE_ARG("smoother solve", solve_measurements_.size());
+    EFK::State S;
+    bool solved = solve(params_, solve_K_, solve_sigma_d_, solve_X0_, solve_information_, solve_ts0_,
+                        solve_measurements_, solve_ts_, S);
+    if (solved) {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        if (!cancelled_) {
+            result_ = S;
+            result_ts_ = solve_ts_;
+            has_result_ = true;
+        }
+    }
+    solving_ = false;
+}
+
+bool FixedLagSmoother::correct(EFK& efk, const PoseHistory& history) {
+    EFK::State S;
+    int64_t ts;
+    {
+        std::lock_guard<std::mutex> lock(result_mutex_);
+        if (!has_result_) return false;
+        has_result_ = false;
+        S = result_;
+        ts = result_ts_;
+    }
+    // the filter at the end of the window, unless it is too old
+    int64_t begin, end;
+    EFK::State H;
+    if (!history.getRange(begin, end) or ts < begin or end - ts > int64_t(params_.window*1e9)
+        or !history.get(ts, H))
+        return false;
+    Vec12 correction;
+    correction << S.r - H.r, logRotation(H.q.conjugate()*S.q),
+                  S.v - H.v, rotationVector(S.w) - rotationVector(H.w);
+    if (!correction.allFinite() or correction.head<3>().norm() > params_.max_correction)
+        return false;
+    // the filter moved on since, the same correction still holds to first order
+    efk.X_.r += correction.segment<3>(0);
+    efk.X_.q = (efk.X_.q*expRotation(correction.segment<3>(3))).normalized();
+    efk.X_.v += correction.segment<3>(6);
+    efk.X_.w = toAngleAxis(rotationVector(efk.X_.w) + correction.segment<3>(9));
+    // the filter was that far off, its covariance covers it from now on
+    Eigen::Matrix<double, 13, 1> d;
+    d << correction.segment<3>(0), rightJacobian(efk.X_.q)*correction.segment<3>(3),
+         correction.segment<6>(6);
+    efk.P_ += d*d.transpose();
+    return true;
+}
+
+EFK::State FixedLagSmoother::move(const EFK::State& X, double dt) {
+    EFK::State S = X;
+    S.r += S.v*dt;
+    S.q = S.q*Quaternion(AngleAxis(S.w.angle()*dt, S.w.axis()));
+    return S;
+}
+
+FixedLagSmoother::Mat12 FixedLagSmoother::information(const EFK::State& X, const Mat13& P, double scale) {
+    // covariance of r, rotation vector of q, v, w from the one of r, q, v, w
+    Eigen::Matrix<double, 12, 13> T = Eigen::Matrix<double, 12, 13>::Zero();
+    T.block<3,3>(0,0).setIdentity();
+    // theta = 2 vec(q^-1 dq)
+    Eigen::Matrix<double, 4, 3> G = rightJacobian(X.q);
+    T.block<3,4>(3,3) = 4*G.transpose();
+    T.block<6,6>(6,7).setIdentity();
+    Mat12 covariance = scale*T*P*T.transpose();
+    // the filter starts from a zero covariance
+    covariance.diagonal().array() += 1e-9;
+    return covariance.ldlt().solve(Mat12::Identity());
+}
+
+bool FixedLagSmoother::solve(const Params& params, const Vec4& K, double sigma_d,
+                             const EFK::State& S0, const Mat12& information, int64_t ts0,
+                             const vector<Measurement>& measurements, int64_t ts, EFK::State& S) {
+    EFK::State X = S0;
+    Eigen::RowVector3d jac_d_r;
+    Eigen::RowVector4d jac_d_q;
+    Eigen::Matrix<double, 1, 12> J;
+    for (uint iteration = 0; iteration < params.iterations; ++iteration) {
+        // prior residual of the tangent space
+        Vec12 e;
+        e << X.r - S0.r, logRotation(S0.q.conjugate()*X.q), X.v - S0.v,
+             rotationVector(X.w) - rotationVector(S0.w);
+        Mat12 H = information;
+        Vec12 g = information*e;
+        for (const Measurement& m : measurements) {
+            double dt = (m.ts - ts0)*1e-9;
+            EFK::State Xi = move(X, dt);
+            SlamLine sl(m.p1, m.p2);
+            sl.project(Xi.r, Xi.q, K);
+            double d = SlamLine::getDistance(sl, m.p, jac_d_r, jac_d_q);
+            // the rotation of the window start and of w move every pose of
+            // the window alike to first order
+            Eigen::RowVector3d jac_d_theta = jac_d_q*rightJacobian(Xi.q);
+            J << jac_d_r, jac_d_theta, dt*jac_d_r, dt*jac_d_theta;
+            // huber weight
+            double weight = std::abs(d) <= params.huber ? 1 : params.huber/std::abs(d);
+            weight /= sigma_d*sigma_d;
+            H += weight*J.transpose()*J;
+            g += weight*J.transpose()*d;
+        }
+        Vec12 delta = -H.ldlt().solve(g);
+        if (!delta.allFinite()) return false;
+        X.r += delta.segment<3>(0);
+        X.q = (X.q*expRotation(delta.segment<3>(3))).normalized();
+        X.v += delta.segment<3>(6);
+        X.w = toAngleAxis(rotationVector(X.w) + delta.segment<3>(9));
+        if (delta.segment<3>(0).norm() < 1e-3 and delta.segment<3>(3).norm() < 1e-6) break;
+    }
+    S = move(X, (ts - ts0)*1e-9);
+    return S.r.allFinite() and S.q.coeffs().allFinite();
+}
+
+} // namespace
@@ -0,0 +1,35 @@
+#include "tracker/idle_detector.h"
+#include <algorithm>
+#include <cmath>
+
+namespace track
+{
+
+IdleDetector::IdleDetector() : IdleDetector(Params()) {}
+
+IdleDetector::IdleDetector(const Params& params) : params_(params) {
+    params_.subsampling = std::max(1u, params_.subsampling);
+    reset();
+}
+
+void IdleDetector::reset() {
+    idle_ = false;
+    still_packets_ = 0;
+}
+
+bool IdleDetector::checkStill(double rate, const EFK::State& X) {
+    bool still = rate < params_.max_rate and X.v.norm() < params_.max_velocity and
+        std::abs(X.w.angle()) < params_.max_angular_velocity;
+    still_packets_ = still ? still_packets_ + 1 : 0;
+    idle_ = still_packets_ >= params_.still_packets;
+    return idle_;
+}
+
+bool IdleDetector::checkMoving(double rate, uint matched, uint associated) {
+    bool moving = rate >= params_.max_rate or
+        (matched >= params_.min_matched and matched >= params_.min_association_ratio*associated);
+    if (moving) reset();
+    return moving;
+}
+
+} // namespace
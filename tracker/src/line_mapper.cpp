@@ -0,0 +1,288 @@
+#include "tracker/line_mapper.h"
+#include <chrono>
+#include <limits>
+#include <Eigen/Eigenvalues>
+
+namespace track
+{
+
+namespace {
+// project a world point in a camera with pose r,q, false if behind the camera
+bool projectPoint(const Point3d& X, const Vec3& r, const Quaternion& q, const Vec4& K, Point2d& p) {
+    Point3d X_c = q.toRotationMatrix().transpose() * (X - r);
+    if (X_c[2] <= 0) return false;
+    p << K[2] * X_c[0]/X_c[2] + K[0],
+         K[3] * X_c[1]/X_c[2] + K[1];
+    return true;
+}
+
+// position of p along segment e1-e2, 0 at e1 and 1 at e2
+double positionOnSegment(const Point2d& e1, const Point2d& e2, const Point2d& p) {
+    Point2d d = e2 - e1;
+    return d.dot(p - e1) / d.squaredNorm();
+}
+}
+
+LineMapper::LineMapper(const Params& params, const std::shared_ptr<const SharedMap>& map,
+                       const SegmentsCallback& callback) :
+    params_(params), map_(map), callback_(callback), got_camera_matrix_(false), running_(true),
+    next_view_id_(0), rng_(42) {
+    buffer_.reserve(params_.max_observations);
+    thread_ = std::thread(&LineMapper::run, this);
+}
+
+LineMapper::~LineMapper() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_one();
+    thread_.join();
+}
+
+void LineMapper::setCameraMatrix(const Vec4& K) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    K_ = K;
+    got_camera_matrix_ = true;
+}
+
+void LineMapper::addObservation(const Point2d& p, double t, const Vec3& r, const Quaternion& q) {
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if (!lock.owns_lock() or buffer_.size() >= params_.max_observations) return;
+    buffer_.push_back(Observation{p, t, r, q});
+    if (buffer_.size() == params_.min_view_events) cond_.notify_one();
+}
+
+void LineMapper::run() {
+    vector<Observation> obs;
+    obs.reserve(params_.max_observations);
+    while (true) {
+        Vec4 K;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait_for(lock, std::chrono::milliseconds(50), [this] {
+                return !running_ or buffer_.size() >= params_.min_view_events; });
+            if (!running_) return;
+            obs.swap(buffer_); // keeps both capacities
+            K = K_;
+            if (!got_camera_matrix_) {
+                obs.clear();
+                continue;
+            }
+        }
+        if (obs.empty()) continue;
+        // time went back (tracker reset, bag loop...), drop old observations
+        if (!pending_.empty() and obs.front().t < pending_.back().t) pending_.clear();
+        pending_.insert(pending_.end(), obs.begin(), obs.end());
+        obs.clear();
+        while (pending_.size() > params_.max_observations) pending_.pop_front();
+
+        // cut pending observations in views of view_duration seconds
+        while (!pending_.empty() and pending_.back().t - pending_.front().t > params_.view_duration) {
+            double t_end = pending_.front().t + params_.view_duration;
+            vector<Observation> view;
+            while (!pending_.empty() and pending_.front().t < t_end) {
+                view.push_back(pending_.front());
+                pending_.pop_front();
+            }
+            if (view.size() >= params_.min_view_events) processView(view, K);
+        }
+    }
+}
+
+void LineMapper::processView(const vector<Observation>& obs, const Vec4& K) {
+    // the pose barely moves during a view, take the middle one
+    const Observation& mid = obs[obs.size()/2];
+    View v { mid.r, mid.q, next_view_id_++ };
+    views_.push_back(v);
+
+    vector<Point2d> points;
+    points.reserve(obs.size());
+    for (const Observation& o : obs) points.push_back(o.p);
+    vector<ViewLine> lines;
+    fitLines(points, v.id, lines);
+
+    // triangulate new lines against older views, newest first. Segments of
+    // the map (loaded or added by any mapper) are not added twice, a copy
+    // of an edge would make its events ambiguous
+    SharedMap::Segments map_segments = map_->getSegments();
+    vector<SlamLine> segments;
+    for (const ViewLine& a : lines) {
+        if (segments.size() >= params_.max_new_segments or
+            added_.size() + segments.size() >= params_.max_segments) break;
+        for (auto it = lines_.rbegin(); it != lines_.rend(); ++it) {
+            SlamLine s(Point3d::Zero(), Point3d::Zero());
+            if (triangulate(a, *it, K, s) and isConfirmed(s, a, *it, K) and
+                !isDuplicate(s, *map_segments, v, K) and !isDuplicate(s, segments, v, K)) {
+                segments.push_back(s);
+                break;
+            }
+        }
+    }
+
+    // update history
+    lines_.insert(lines_.end(), lines.begin(), lines.end());
+    while (views_.size() > params_.history_views) {
+        int old = views_.front().id;
+        views_.pop_front();
+        while (!lines_.empty() and lines_.front().view == old) lines_.pop_front();
+    }
+
+    if (!segments.empty()) {
+        added_.insert(added_.end(), segments.begin(), segments.end());
+        callback_(segments);
+    }
+}
+
+void LineMapper::fitLines(vector<Point2d> points, int view, vector<ViewLine>& lines) {
+    // sequential RANSAC, inliers of a line are removed before looking for the next
+    const double inf = std::numeric_limits<double>::infinity();
+    vector<Point2d> outliers;
+    while (lines.size() < params_.max_lines_per_view and points.size() >= params_.min_line_inliers) {
+        std::uniform_int_distribution<int> pick(0, points.size() - 1);
+        Vec3 best_l = Vec3::Zero();
+        uint best_count = 0;
+        for (uint i = 0; i < params_.ransac_iterations; ++i) {
+            const Point2d& p1 = points[pick(rng_)];
+            const Point2d& p2 = points[pick(rng_)];
+            Vec3 l = Vec3(p1[0], p1[1], 1).cross(Vec3(p2[0], p2[1], 1));
+            double n = l.head<2>().norm();
+            if (n < 1e-9) continue;
+            l /= n;
+            uint count = 0;
+            for (const Point2d& p : points)
+                if (std::abs(l[0]*p[0] + l[1]*p[1] + l[2]) < params_.inlier_distance) ++count;
+            if (count > best_count) {
+                best_count = count;
+                best_l = l;
+            }
+        }
+        if (best_count < params_.min_line_inliers) return;
+
+        // refine with the principal direction of the inliers
+        Point2d mean = Point2d::Zero();
+        Eigen::Matrix2d cov = Eigen::Matrix2d::Zero();
+        outliers.clear();
+        vector<Point2d> inliers;
+        for (const Point2d& p : points) {
+            if (std::abs(best_l[0]*p[0] + best_l[1]*p[1] + best_l[2]) < params_.inlier_distance)
+                inliers.push_back(p);
+            else
+                outliers.push_back(p);
+        }
+        for (const Point2d& p : inliers) mean += p;
+        mean /= inliers.size();
+        for (const Point2d& p : inliers) cov += (p - mean) * (p - mean).transpose();
+        Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> es(cov);
+        Point2d dir = es.eigenvectors().col(1);
+
+        ViewLine vl;
+        vl.l << -dir[1], dir[0], dir[1]*mean[0] - dir[0]*mean[1];
+        double tmin = inf, tmax = -inf;
+        for (const Point2d& p : inliers) {
+            double t = dir.dot(p - mean);
+            tmin = std::min(tmin, t);
+            tmax = std::max(tmax, t);
+        }
+        vl.e1 = mean + tmin*dir;
+        vl.e2 = mean + tmax*dir;
+        vl.view = view;
+        lines.push_back(vl);
+        points.swap(outliers);
+    }
+}
+
+bool LineMapper::triangulate(const ViewLine& a, const ViewLine& b, const Vec4& K, SlamLine& segment) {
+    // each 2d line back-projects to a plane through its camera center,
+    // the 3d line is the intersection of both planes
+    if (a.view == b.view) return false;
+    const View* va = findView(a.view);
+    const View* vb = findView(b.view);
+    if (!va or !vb) return false;
+
+    double u0 = K[0], u1 = K[1], fx = K[2], fy = K[3];
+    Eigen::Matrix3d Km;
+    Km << fx,  0, u0,
+           0, fy, u1,
+           0,  0,  1;
+    Eigen::Matrix3d Ra = va->q.toRotationMatrix();
+    Eigen::Matrix3d Rb = vb->q.toRotationMatrix();
+    // plane normals in world frame: l' K X_c = 0 and X_c = R' (X - r)
+    Vec3 na = (Ra * (Km.transpose() * a.l)).normalized();
+    Vec3 nb = (Rb * (Km.transpose() * b.l)).normalized();
+    if (na.cross(nb).norm() < params_.min_parallax) return false; // planes almost parallel
+
+    // intersect rays through the endpoints of a with plane of b
+    double db = nb.dot(vb->r);
+    const Point2d* e[2] = { &a.e1, &a.e2 };
+    Point3d X[2];
+    for (int i = 0; i < 2; ++i) {
+        Vec3 ray = Ra * Vec3(((*e[i])[0] - u0)/fx, ((*e[i])[1] - u1)/fy, 1);
+        double den = nb.dot(ray);
+        if (std::abs(den) < 1e-9) return false;
+        double s = (db - nb.dot(va->r)) / den;
+        if (s <= 0) return false;
+        X[i] = va->r + s*ray;
+    }
+    if ((X[1] - X[0]).norm() < params_.min_length) return false;
+
+    // both lines must see the same part of the edge
+    Point2d p1, p2;
+    if (!projectPoint(X[0], vb->r, vb->q, K, p1) or !projectPoint(X[1], vb->r, vb->q, K, p2))
+        return false;
+    double t1 = positionOnSegment(b.e1, b.e2, p1);
+    double t2 = positionOnSegment(b.e1, b.e2, p2);
+    if (std::max(t1, t2) < 0 or std::min(t1, t2) > 1) return false;
+
+    segment = SlamLine(X[0], X[1]);
+    return true;
+}
+
+bool LineMapper::isConfirmed(const SlamLine& segment, const ViewLine& a, const ViewLine& b, const Vec4& K) {
+    // a third view must have seen a line where the segment projects
+    for (const ViewLine& c : lines_) {
+        if (c.view == a.view or c.view == b.view) continue;
+        const View* vc = findView(c.view);
+        Point2d p1, p2;
+        if (!vc or !projectPoint(segment.p1_3d, vc->r, vc->q, K, p1) or
+                   !projectPoint(segment.p2_3d, vc->r, vc->q, K, p2)) continue;
+        const double max_distance = 2*params_.inlier_distance;
+        if (std::abs(c.l.dot(Vec3(p1[0], p1[1], 1))) > max_distance or
+            std::abs(c.l.dot(Vec3(p2[0], p2[1], 1))) > max_distance) continue;
+        double t1 = positionOnSegment(c.e1, c.e2, p1);
+        double t2 = positionOnSegment(c.e1, c.e2, p2);
+        if (std::max(t1, t2) >= 0 and std::min(t1, t2) <= 1) return true;
+    }
+    return false;
+}
+
+bool LineMapper::isDuplicate(const SlamLine& segment, const vector<SlamLine>& segments,
+                             const View& v, const Vec4& K) {
+    // compared in the image, triangulated depth is much noisier than the projection
+    Point2d p1, p2;
+    if (!projectPoint(segment.p1_3d, v.r, v.q, K, p1) or
+        !projectPoint(segment.p2_3d, v.r, v.q, K, p2)) return false;
+    for (const SlamLine& s : segments) {
+        Point2d s1, s2;
+        if (!projectPoint(s.p1_3d, v.r, v.q, K, s1) or
+            !projectPoint(s.p2_3d, v.r, v.q, K, s2)) continue;
+        Vec3 l = Vec3(s1[0], s1[1], 1).cross(Vec3(s2[0], s2[1], 1));
+        double n = l.head<2>().norm();
+        if (n < 1e-9) continue;
+        l /= n;
+        if (std::abs(l.dot(Vec3(p1[0], p1[1], 1))) > params_.merge_distance or
+            std::abs(l.dot(Vec3(p2[0], p2[1], 1))) > params_.merge_distance) continue;
+        double t1 = positionOnSegment(s1, s2, p1);
+        double t2 = positionOnSegment(s1, s2, p2);
+        if (std::max(t1, t2) >= 0 and std::min(t1, t2) <= 1) return true;
+    }
+    return false;
+}
+
+const LineMapper::View* LineMapper::findView(int id) const {
+    // views are sorted by id
+    if (views_.empty() or id < views_.front().id or id > views_.back().id) return nullptr;
+    return &views_[id - views_.front().id];
+}
+
+} // namespace
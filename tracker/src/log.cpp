@@ -0,0 +1,34 @@
+#include "tracker/log.h"
+#include <iostream>
+
+namespace track
+{
+namespace log
+{
+
+namespace {
+
+const char* const LEVEL_NAMES[] = {"DEBUG", "INFO", "WARN", "ERROR"};
+
+Handler handler_ = [](Level level, const std::string& message) {
+    std::cerr << '[' << LEVEL_NAMES[level] << "] " << message << std::endl;
+};
+Filter enabled_ = [](Level level) { return level >= Info; };
+
+}
+
+void setHandler(const Handler& handler, const Filter& enabled) {
+    handler_ = handler;
+    enabled_ = enabled;
+}
+
+bool enabled(Level level) {
+    return enabled_(level);
+}
+
+void write(Level level, const std::string& message) {
+    handler_(level, message);
+}
+
+}
+}
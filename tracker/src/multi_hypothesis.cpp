@@ -0,0 +1,109 @@
+#include "tracker/multi_hypothesis.h"
+#include <cmath>
+
+namespace track
+{
+
+MultiHypothesis::MultiHypothesis(const Params& params, const Vec3& sigma_v, const Vec3& sigma_w,
+                                 double sigma_d, ThreadPool& pool) :
+    params_(params), pool_(pool), selected_(0), pending_(0) {
+    // noise scales ratio^k centered on 1, the main filter settings
+    for (uint i = 0; i < params_.hypotheses; ++i) {
+        double scale = std::pow(params_.scale_ratio, i - (params_.hypotheses - 1)/2.0);
+        scales_.push_back(scale);
+        hypotheses_.push_back(Hypothesis { EFK(scale*sigma_v, scale*sigma_w, sigma_d), 0 });
+        if (std::abs(scale - 1) < 1e-9) selected_ = i;
+    }
+}
+
+MultiHypothesis::~MultiHypothesis() {
+    wait();
+}
+
+void MultiHypothesis::init(const EFK::State& X0, const Vec4& K) {
+    wait();
+    K_ = K;
+    for (Hypothesis& h : hypotheses_) {
+        h.efk.init(X0);
+        h.log_likelihood = 0;
+    }
+    measurements_.clear();
+}
+
+void MultiHypothesis::setNoise(const Vec3& sigma_v, const Vec3& sigma_w, double sigma_d) {
+    wait();
+    for (uint i = 0; i < hypotheses_.size(); ++i)
+        hypotheses_[i].efk.setNoise(scales_[i]*sigma_v, scales_[i]*sigma_w, sigma_d);
+}
+
+void MultiHypothesis::process(vector<Measurement>& measurements) {
+    wait();
+    measurements_.swap(measurements);
+    measurements.clear();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = hypotheses_.size();
+    }
+    for (Hypothesis& h : hypotheses_)
+        pool_.enqueue([this, &h] {
+            run(h);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_.notify_all();
+        });
+}
+
+bool MultiHypothesis::select(EFK& efk) {
+    wait();
+    int best = -1;
+    for (uint i = 0; i < hypotheses_.size(); ++i) {
+        double ll = hypotheses_[i].log_likelihood;
+        if (std::isfinite(ll) and (best < 0 or ll > hypotheses_[best].log_likelihood)) best = i;
+    }
+    if (best < 0) return false; // every hypothesis diverged
+
+    // switch if the best one is clearly better than the selected one
+    const Hypothesis& b = hypotheses_[best];
+    bool switched = best != int(selected_) and
+        !(b.log_likelihood < hypotheses_[selected_].log_likelihood + params_.switch_margin);
+    if (switched) {
+        selected_ = best;
+        efk = b.efk;
+    }
+
+    // respawn hypotheses far behind from the best state, keeping their noise
+    for (Hypothesis& h : hypotheses_) {
+        if (!std::isfinite(h.log_likelihood) or
+            h.log_likelihood < b.log_likelihood - params_.prune_margin) {
+            h.efk.X_ = b.efk.X_;
+            h.efk.P_ = b.efk.P_;
+            h.log_likelihood = b.log_likelihood;
+        }
+    }
+    return switched;
+}
+
+void MultiHypothesis::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void MultiHypothesis::run(Hypothesis& h) {
+    // same steps as Tracker::handleEvent for a matched event
+    double log_likelihood = 0;
+    Eigen::RowVector3d jac_d_r;
+    Eigen::RowVector4d jac_d_q;
+    Eigen::Matrix<double, 1, 7> H;
+    for (const Measurement& m : measurements_) {
+        h.efk.predict(m.dt);
+        SlamLine sl(m.p1, m.p2);
+        sl.project(h.efk.X_.r, h.efk.X_.q, K_);
+        double dist = SlamLine::getDistance(sl, m.p, jac_d_r, jac_d_q);
+        H << jac_d_r, jac_d_q;
+        double Z = H * h.efk.P_.block<7,7>(0,0) * H.transpose() + h.efk.R_;
+        // gaussian log-likelihood of the innovation, without constant
+        log_likelihood -= 0.5*(h.efk.update(dist, H) + std::log(Z));
+    }
+    h.log_likelihood = params_.decay*h.log_likelihood + log_likelihood;
+}
+
+} // namespace
@@ -0,0 +1,137 @@
+#include "tracker/pose_history.h"
+#include <algorithm>
+#include <limits>
+
+namespace track
+{
+
+PoseHistory::PoseHistory(const Params& params) :
+    params_(params), slots_(new Slot[std::max(2u, params.size)]), end_(0), begin_(0) {
+    params_.size = std::max(2u, params_.size);
+    for (uint i = 0; i < params_.size; ++i) slots_[i].seq.store(0, std::memory_order_relaxed);
+    last_ts_ = std::numeric_limits<int64_t>::min();
+}
+
+void PoseHistory::add(const EFK::State& S, int64_t ts, bool force) {
+    uint64_t i = end_.load(std::memory_order_relaxed);
+    bool empty = begin_.load(std::memory_order_relaxed) == i;
+    if (!empty and ts < last_ts_) {
+        // replayed or restarted stream
+        clear();
+        empty = true;
+    }
+    if (!empty and (ts == last_ts_ or (!force and ts - last_ts_ < params_.period))) return;
+    last_ts_ = ts;
+
+    Slot& slot = slots_[i % params_.size];
+    // readers of the entry this one overwrites see it invalid
+    slot.seq.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    Vec3 w = S.w.angle()*S.w.axis();
+    const double x[13] = { S.r[0], S.r[1], S.r[2], S.q.w(), S.q.x(), S.q.y(), S.q.z(),
+                           S.v[0], S.v[1], S.v[2], w[0], w[1], w[2] };
+    slot.ts.store(ts, std::memory_order_relaxed);
+    for (int k = 0; k < 13; ++k) slot.x[k].store(x[k], std::memory_order_relaxed);
+    slot.seq.store(i + 1, std::memory_order_release);
+    end_.store(i + 1, std::memory_order_release);
+}
+
+void PoseHistory::clear() {
+    begin_.store(end_.load(std::memory_order_relaxed), std::memory_order_release);
+    last_ts_ = std::numeric_limits<int64_t>::min();
+}
+
+bool PoseHistory::read(uint64_t i, int64_t& ts, double x[13]) const {
+    const Slot& slot = slots_[i % params_.size];
+    uint64_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq != i + 1) return false;
+    ts = slot.ts.load(std::memory_order_relaxed);
+    if (x)
+        for (int k = 0; k < 13; ++k) x[k] = slot.x[k].load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return slot.seq.load(std::memory_order_relaxed) == seq;
+}
+
+void PoseHistory::range(uint64_t& begin, uint64_t& end) const {
+    end = end_.load(std::memory_order_acquire);
+    begin = begin_.load(std::memory_order_acquire);
+    // the oldest slot may be being overwritten
+    if (end - begin >= params_.size) begin = end - params_.size + 1;
+}
+
+EFK::State PoseHistory::toState(const double x[13]) {
+    EFK::State S;
+    S.r = Vec3(x[0], x[1], x[2]);
+    S.q = Quaternion(x[3], x[4], x[5], x[6]);
+    S.v = Vec3(x[7], x[8], x[9]);
+    Vec3 w(x[10], x[11], x[12]);
+    double angle = w.norm();
+    S.w = angle > 0 ? AngleAxis(angle, w/angle) : AngleAxis(0, Vec3::UnitZ());
+    return S;
+}
+
+bool PoseHistory::tryGet(int64_t ts, EFK::State& S, bool& found) const {
+    found = false;
+    uint64_t begin, end;
+    range(begin, end);
+    if (begin == end) return true;
+
+    double x0[13], x1[13];
+    int64_t ts0, ts1;
+    if (!read(end - 1, ts1, x1)) return false;
+    if (ts >= ts1) {
+        // constant velocity prediction, as EFK::predict
+        if (ts - ts1 > params_.max_extrapolation) return true;
+        double dt = (ts - ts1)*1e-9;
+        S = toState(x1);
+        S.r += S.v*dt;
+        S.q *= Quaternion(AngleAxis(S.w.angle()*dt, S.w.axis()));
+        found = true;
+        return true;
+    }
+    if (!read(begin, ts0, nullptr)) return false;
+    if (ts < ts0) return true;
+
+    // binary search of the last entry at or before ts, ts(lo) <= ts < ts(hi)
+    uint64_t lo = begin, hi = end - 1;
+    while (hi - lo > 1) {
+        uint64_t mid = lo + (hi - lo)/2;
+        int64_t t;
+        if (!read(mid, t, nullptr)) return false;
+        if (t <= ts) lo = mid;
+        else hi = mid;
+    }
+    if (!read(lo, ts0, x0) or !read(hi, ts1, x1)) return false;
+
+    double a = double(ts - ts0)/(ts1 - ts0);
+    EFK::State S0 = toState(x0), S1 = toState(x1);
+    S.r = (1 - a)*S0.r + a*S1.r;
+    S.q = S0.q.slerp(a, S1.q);
+    S.v = (1 - a)*S0.v + a*S1.v;
+    Vec3 w = (1 - a)*S0.w.angle()*S0.w.axis() + a*S1.w.angle()*S1.w.axis();
+    double angle = w.norm();
+    S.w = angle > 0 ? AngleAxis(angle, w/angle) : AngleAxis(0, Vec3::UnitZ());
+    found = true;
+    return true;
+}
+
+bool PoseHistory::get(int64_t ts, EFK::State& S) const {
+    // a lookup only fails when the writer went round the whole ring meanwhile
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        bool found;
+        if (tryGet(ts, S, found)) return found;
+    }
+    return false;
+}
+
+bool PoseHistory::getRange(int64_t& begin, int64_t& end) const {
+    for (int attempt = 0; attempt < 8; ++attempt) {
+        uint64_t b, e;
+        range(b, e);
+        if (b == e) return false;
+        if (read(b, begin, nullptr) and read(e - 1, end, nullptr)) return true;
+    }
+    return false;
+}
+
+} // namespace
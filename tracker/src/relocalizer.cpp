@@ -0,0 +1,109 @@
+#include "tracker/relocalizer.h"
+#include <limits>
+
+namespace track
+{
+
+namespace {
+// candidate i of a 3x3x3x3x3x3 grid around r_c,q_c, digits of i in base 3
+// are -1,0,+1 steps in position and in rotation (camera frame)
+const uint CANDIDATES = 729;
+void candidatePose(uint i, const Vec3& r_c, const Quaternion& q_c, double step_r, double step_w,
+                   Vec3& r, Quaternion& q) {
+    double d[6];
+    for (int k = 0; k < 6; ++k) {
+        d[k] = double(i % 3) - 1;
+        i /= 3;
+    }
+    r = r_c + step_r*Vec3(d[0], d[1], d[2]);
+    Vec3 w(d[3], d[4], d[5]);
+    q = q_c;
+    if (w.norm() > 0) q = q_c * Quaternion(AngleAxis(step_w*w.norm(), w.normalized()));
+}
+}
+
+Relocalizer::Relocalizer(const Params& params, ThreadPool& pool) :
+    params_(params), pool_(pool), history_(params.history_size), head_(0), count_(0) {}
+
+void Relocalizer::addEvent(const Point2d& p, double t) {
+    history_[head_] = Event{p, t};
+    head_ = (head_ + 1) % history_.size();
+    if (count_ < history_.size()) ++count_;
+}
+
+void Relocalizer::clear() {
+    head_ = count_ = 0;
+}
+
+double Relocalizer::score(vector<SlamLine>& segments, const vector<Point2d>& events,
+                          const Vec4& K, const Vec3& r, const Quaternion& q, double sigma) {
+    for (SlamLine& sl : segments) sl.project(r, q, K);
+    // truncated quadratic kernel on the distance to the closest aligned segment
+    double total = 0;
+    const double sigma2 = sigma*sigma;
+    for (const Point2d& p : events) {
+        double best = sigma2;
+        for (const SlamLine& sl : segments) {
+            if (!SlamLine::isAligned(sl, p)) continue;
+            double d = SlamLine::getDistance(sl, p);
+            best = std::min(best, d*d);
+        }
+        total += 1 - best/sigma2;
+    }
+    return events.empty() ? 0 : total / events.size();
+}
+
+bool Relocalizer::relocalize(const vector<SlamLine>& segments, const Vec4& K,
+                             const Vec3& r0, const Quaternion& q0,
+                             Vec3& r, Quaternion& q, double& best_score) {
+    // newest events of the last history_duration seconds
+    vector<Point2d> events;
+    events.reserve(params_.max_events);
+    const uint size = history_.size();
+    double t_last = count_ > 0 ? history_[(head_ + size - 1) % size].t : 0;
+    for (uint i = 1; i <= count_ and events.size() < params_.max_events; ++i) {
+        const Event& e = history_[(head_ + size - i) % size];
+        if (t_last - e.t > params_.history_duration) break;
+        events.push_back(e.p);
+    }
+    if (events.empty() or segments.empty()) return false;
+
+    r = r0;
+    q = q0;
+    double step_r = params_.step_position;
+    double step_w = params_.step_angle;
+    vector<SlamLine> local(segments);
+    vector<double> scores(CANDIDATES);
+    for (uint level = 0; level < params_.levels; ++level) {
+        // the kernel shrinks with the steps so coarse levels see far events
+        const double sigma = params_.sigma * (1 << (params_.levels - 1 - level));
+        best_score = score(local, events, K, r, q, sigma);
+        // hill climbing on the grid, then refine with half steps
+        for (uint it = 0; it < params_.level_iterations; ++it) {
+            const Vec3 r_c = r;
+            const Quaternion q_c = q;
+            pool_.parallelFor(CANDIDATES, [&](uint begin, uint end) {
+                vector<SlamLine> sl(segments); // projections are per thread
+                Vec3 r_i;
+                Quaternion q_i;
+                for (uint i = begin; i < end; ++i) {
+                    candidatePose(i, r_c, q_c, step_r, step_w, r_i, q_i);
+                    scores[i] = score(sl, events, K, r_i, q_i, sigma);
+                }
+            });
+            uint best = CANDIDATES;
+            for (uint i = 0; i < CANDIDATES; ++i)
+                if (scores[i] > best_score) {
+                    best_score = scores[i];
+                    best = i;
+                }
+            if (best == CANDIDATES) break; // center is the best
+            candidatePose(best, r_c, q_c, step_r, step_w, r, q);
+        }
+        step_r /= 2;
+        step_w /= 2;
+    }
+    return best_score >= params_.min_score;
+}
+
+} // namespace
@@ -0,0 +1,58 @@
+#include "tracker/shared_map.h"
+#include "tracker/trace.h"
+#include "tracker/tracker_map.h"
+
+namespace track
+{
+
+SharedMap::SharedMap() :
+    segments_(std::make_shared<const vector<SlamLine> >(TrackerMap().copySegments())),
+    version_(0), loading_(false) {}
+
+SharedMap::~SharedMap() {
+    if (loader_.joinable()) loader_.join();
+}
+
+void SharedMap::setSegments(const vector<SlamLine>& segments) {
+    Segments s = std::make_shared<const vector<SlamLine> >(segments);
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::atomic_store(&segments_, s);
+    ++version_; // after the segments, see getSegments
+}
+
+void SharedMap::appendSegments(const vector<SlamLine>& segments) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    vector<SlamLine> all(*segments_);
+    all.insert(all.end(), segments.begin(), segments.end());
+    std::atomic_store(&segments_, std::make_shared<const vector<SlamLine> >(std::move(all)));
+    ++version_;
+}
+
+bool SharedMap::load(const std::string& path) {
+    vector<SlamLine> segments;
+    if (!TrackerMap::loadSegments(path, segments) or segments.empty()) {
+        TRACK_ERROR_STREAM("could not load map " << path << ", keeping current map");
+        return false;
+    }
+    setSegments(segments);
+    TRACK_INFO_STREAM("loaded map " << path << " with " << segments.size() << " segments");
+    return true;
+}
+
+bool SharedMap::loadAsync(const std::string& path) {
+    if (loading_.exchange(true)) {
+        TRACK_WARN_STREAM("already loading a map, ignoring " << path);
+        return false;
+    }
+    if (loader_.joinable()) loader_.join(); // previous loader is done
+    TRACK_INFO_STREAM("loading map " << path);
+    loader_ = std::thread([this, path] {
+        TRACK_TRACE_THREAD("map loader");
+        TRACK_TRACE_SCOPE("load map");
+        load(path);
+        loading_ = false;
+    });
+    return true;
+}
+
+} // namespace
@@ -0,0 +1,103 @@
+#include "tracker/thread_pool.h"
+#include "tracker/trace.h"
+#include <algorithm>
+#include <atomic>
+
+namespace track
+{
+
+ThreadPool::ThreadPool(uint threads) : tasks_(16), head_(0), queued_(0), running_(true) {
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint i = 0; i < threads; ++i)
+        workers_.push_back(std::thread(&ThreadPool::run, this));
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cond_.notify_all();
+    for (std::thread& t : workers_) t.join();
+}
+
+void ThreadPool::enqueue(const std::function<void()>& task) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        push(task);
+    }
+    cond_.notify_one();
+}
+
+void ThreadPool::push(const std::function<void()>& task) {
+    if (queued_ == tasks_.size()) {
+        // full, unroll the ring into a twice bigger one
+        std::vector<std::function<void()> > tasks(2*tasks_.size());
+        for (size_t i = 0; i < queued_; ++i) tasks[i] = std::move(tasks_[(head_ + i) % tasks_.size()]);
+        tasks_.swap(tasks);
+        head_ = 0;
+    }
+    tasks_[(head_ + queued_) % tasks_.size()] = task;
+    ++queued_;
+}
+
+void ThreadPool::pop(std::function<void()>& task) {
+    task = std::move(tasks_[head_]);
+    // release the captures now
+    tasks_[head_] = nullptr;
+    head_ = (head_ + 1) % tasks_.size();
+    --queued_;
+}
+
+void ThreadPool::parallelFor(uint n, const std::function<void(uint begin, uint end)>& f) {
+    if (n == 0) return;
+    const uint chunks = std::min<uint>(n, workers_.size() + 1);
+    std::atomic<uint> remaining(chunks);
+    std::mutex done_mutex;
+    std::condition_variable done;
+    auto run_chunk = [&](uint c) {
+        f(n*c/chunks, n*(c + 1)/chunks);
+        if (--remaining == 0) {
+            std::lock_guard<std::mutex> lock(done_mutex);
+            done.notify_all();
+        }
+    };
+    for (uint c = 1; c < chunks; ++c)
+        enqueue([&run_chunk, c] { run_chunk(c); });
+    run_chunk(0);
+
+    // help with queued tasks while waiting, so nested calls from a worker can't deadlock
+    std::function<void()> task;
+    while (remaining > 0) {
+        if (tryPop(task)) {
+            task();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done.wait(lock, [&remaining] { return remaining == 0; });
+    }
+}
+
+bool ThreadPool::tryPop(std::function<void()>& task) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (queued_ == 0) return false;
+    pop(task);
+    return true;
+}
+
+void ThreadPool::run() {
+    TRACK_TRACE_THREAD("pool worker");
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [this] { return !running_ or queued_ > 0; });
+            if (!running_ and queued_ == 0) return;
+            pop(task);
+        }
+        TRACK_TRACE_SCOPE("pool task");
+        task();
+    }
+}
+
+} // namespace
@@ -0,0 +1,139 @@
+#include "tracker/trace.h"
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+#include <limits>
+
+namespace track
+{
+namespace trace
+{
+
+namespace {
+
+struct Span {
+    const char* name;
+    uint64_t begin, end; // ns
+    int64_t arg;         // -1 if none
+};
+
+struct Buffer {
+    // ring of the last spans, spans[i % size] is the i-th span recorded
+    std::vector<Span> spans;
+    // spans recorded, published after the span is written
+    std::atomic<uint64_t> recorded;
+    int tid;
+    std::string name;
+};
+
+std::atomic<bool> enabled_(false);
+size_t capacity_ = 1 << 16;
+// buffers outlive their threads, so that spans can be written at exit
+std::mutex buffers_mutex_;
+std::vector<std::unique_ptr<Buffer> > buffers_;
+thread_local Buffer* buffer_ = nullptr;
+
+// buffer of the calling thread, allocated on its first span
+Buffer& threadBuffer() {
+    if (!buffer_) {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        std::unique_ptr<Buffer> buffer(new Buffer());
+        buffer->spans.resize(capacity_);
+        buffer->recorded = 0;
+        buffer->tid = int(buffers_.size()) + 1;
+        buffer->name = "thread " + std::to_string(buffer->tid);
+        buffer_ = buffer.get();
+        buffers_.push_back(std::move(buffer));
+    }
+    return *buffer_;
+}
+
+void writeString(std::ostream& out, const std::string& s) {
+    out << '"';
+    for (char c : s) {
+        if (c == '"' or c == '\\') out << '\\';
+        if (c >= 0 and c < 0x20) continue;
+        out << c;
+    }
+    out << '"';
+}
+
+}
+
+void enable(size_t spans_per_thread) {
+    {
+        std::lock_guard<std::mutex> lock(buffers_mutex_);
+        // buffers already allocated keep their size
+        capacity_ = std::max<size_t>(1, spans_per_thread);
+    }
+    enabled_ = true;
+}
+
+bool enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+}
+
+void setThreadName(const std::string& name) {
+    if (!enabled()) return;
+    Buffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    buffer.name = name;
+}
+
+uint64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void record(const char* name, uint64_t begin, uint64_t end, int64_t arg) {
+    Buffer& buffer = threadBuffer();
+    uint64_t i = buffer.recorded.load(std::memory_order_relaxed);
+    buffer.spans[i % buffer.spans.size()] = Span { name, begin, end, arg };
+    buffer.recorded.store(i + 1, std::memory_order_release);
+}
+
+bool write(const std::string& path) {
+    std::ofstream out(path);
+    if (!out) return false;
+    std::lock_guard<std::mutex> lock(buffers_mutex_);
+    // times from the first span kept, in us as Chrome expects
+    uint64_t origin = std::numeric_limits<uint64_t>::max();
+    for (const std::unique_ptr<Buffer>& buffer : buffers_) {
+        uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+        size_t size = buffer->spans.size();
+        for (uint64_t i = recorded > size ? recorded - size : 0; i < recorded; ++i)
+            origin = std::min(origin, buffer->spans[i % size].begin);
+    }
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    out << std::fixed << std::setprecision(3);
+    bool first = true;
+    for (const std::unique_ptr<Buffer>& buffer : buffers_) {
+        if (!first) out << ",\n";
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->tid <<
+            ",\"args\":{\"name\":";
+        writeString(out, buffer->name);
+        out << "}}";
+        uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+        size_t size = buffer->spans.size();
+        for (uint64_t i = recorded > size ? recorded - size : 0; i < recorded; ++i) {
+            const Span& span = buffer->spans[i % size];
+            // overwritten while writing
+            if (span.begin < origin or span.end < span.begin) continue;
+            out << ",\n{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->tid <<
+                ",\"ts\":" << (span.begin - origin)*1e-3 << ",\"dur\":" << (span.end - span.begin)*1e-3;
+            if (span.arg >= 0) out << ",\"args\":{\"n\":" << span.arg << '}';
+            out << '}';
+        }
+    }
+    out << "\n]}\n";
+    return bool(out);
+}
+
+}
+}
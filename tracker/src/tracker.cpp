@@ -1,137 +1,485 @@
 #include "tracker/tracker.h"
+#include "tracker/trace.h"
+#include <fstream>
+#include <sstream>
+#include <iomanip>
 
 namespace track
 {
 
-Tracker::Tracker(ros::NodeHandle & nh) : nh_(nh) {
-  got_camera_info_ = false;
-  got_camera_pose_ = false;
-  is_tracking_running_ = false;
-
-  efk_ = EFK(sigma_v, sigma_w, sigma_d);
-  
-// **** DEBUG ****
-//   EFK::State X0;
-//   X0.r << 0,0,0;
-//   X0.q = Quaternion(1,0,0,0);
-//   X0.v << 1,0,0;
-//   X0.w = AngleAxis(0, Vec3::UnitX());
-//   efk_.init(X0);
-//   ROS_DEBUG_STREAM(" init X0 is \n" << "r:" << efk_.X_.r.transpose() << ',' <<
-//         "\nq:" << efk_.X_.q.coeffs().transpose() << ',' <<
-//         "\nv:" << efk_.X_.v.transpose() << ',' <<
-//         "\nw:" << efk_.X_.w.angle() << '-' << efk_.X_.w.axis().transpose());
-//   ROS_DEBUG_STREAM(" init P is \n" << efk_.P_);
+namespace {
+
+// core messages go to rosconsole, with the level of the node logger
+bool rosLogEnabled(log::Level level) {
+    switch (level) {
+    case log::Debug: {
+        ROSCONSOLE_DEFINE_LOCATION(true, ::ros::console::levels::Debug, ROSCONSOLE_DEFAULT_NAME);
+        return __rosconsole_define_location__enabled;
+    }
+    case log::Info: {
+        ROSCONSOLE_DEFINE_LOCATION(true, ::ros::console::levels::Info, ROSCONSOLE_DEFAULT_NAME);
+        return __rosconsole_define_location__enabled;
+    }
+    default:
+        return true;
+    }
+}
+
+void rosLog(log::Level level, const std::string& message) {
+    switch (level) {
+    case log::Debug: ROS_DEBUG_STREAM(message); break;
+    case log::Info: ROS_INFO_STREAM(message); break;
+    case log::Warn: ROS_WARN_STREAM(message); break;
+    case log::Error: ROS_ERROR_STREAM(message); break;
+    }
+}
+
+diagnostic_msgs::KeyValue keyValue(const std::string& key, const std::string& value) {
+    diagnostic_msgs::KeyValue kv;
+    kv.key = key;
+    kv.value = value;
+    return kv;
+}
+
+// "mean p50 p90 p99 max (count)" in us
+std::string formatLatency(const LatencyHistogram& h) {
+    std::ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << h.mean()*1e-3 << ' ' << h.percentile(0.5)*1e-3 << ' ' <<
+        h.percentile(0.9)*1e-3 << ' ' << h.percentile(0.99)*1e-3 << ' ' << h.max()*1e-3 <<
+        " (" << h.count() << ')';
+    return ss.str();
+}
+
+}
+
+Tracker::Tracker(ros::NodeHandle & nh, ros::NodeHandle & pnh,
+                 const std::shared_ptr<SharedMap>& map,
+                 const std::shared_ptr<ThreadPool>& pool) :
+    nh_(nh), shared_map_(map), pool_(pool) {
+  log::setHandler(rosLog, rosLogEnabled);
+  event_counter_ = 0;
+  publish_map_events_rate_ = 1000;
+  // spans of the event path, recorded when built with TRACKER_TRACING
+  pnh.param("trace_file", trace_file_, std::string());
+#ifdef TRACKER_TRACING
+  int trace_spans;
+  pnh.param("trace_spans", trace_spans, 1 << 16);
+  trace::enable(std::max(1, trace_spans));
+#endif
+  TrackerCore::Params params;
+  pnh.param("auto_reset", params.auto_reset, true);
+  pnh.param("relocalization", params.relocalization, true);
+  // run more filters with other noise settings in the pool
+  pnh.param("hypotheses", params.hypotheses, 0);
+  // refine the filter over the last packets in the pool
+  pnh.param("smoothing", params.smoothing, false);
+  // grow the (shared) map from unmatched events
+  pnh.param("mapping", params.mapping, false);
+  // freeze the pose and sample few events while the camera is still
+  pnh.param("idle_mode", params.idle_mode, false);
+  // start without /reset once track_init is consistent, from the events since its pose
+  pnh.param("auto_start", params.auto_start, false);
+  pnh.param("start_poses", params.start_poses, params.start_poses);
+  pnh.param("start_buffer", params.start_buffer, params.start_buffer);
+  int stats_sampling;
+  pnh.param("stats_sampling", stats_sampling, int(params.stats_sampling));
+  params.stats_sampling = std::max(0, stats_sampling);
+  pnh.param("stats_period", stats_period_, 1.0);
+  pnh.param("stats_file", stats_file_, std::string());
+
+  // own pool and map unless shared with other trackers
+  if (!pool_) {
+    int threads;
+    pnh.param("threads", threads, 0);
+    pool_ = std::make_shared<ThreadPool>(threads);
+  }
+  bool own_map = !shared_map_;
+  if (own_map) {
+    shared_map_ = std::make_shared<SharedMap>();
+    // replace the default map if a map file is given
+    std::string map_file;
+    if (pnh.getParam("map_file", map_file)) shared_map_->load(map_file);
+  }
+
+  // camera pose in the body frame [x y z qx qy qz qw]
+  vector<double> extrinsics;
+  has_extrinsics_ = pnh.getParam("extrinsics", extrinsics) and extrinsics.size() == 7;
+  if (has_extrinsics_) {
+    body_t_cam_ = Vec3(extrinsics[0], extrinsics[1], extrinsics[2]);
+    body_q_cam_ = Quaternion(extrinsics[6], extrinsics[3], extrinsics[4], extrinsics[5]).normalized();
+  }
+
+  // resume from the checkpoint of a previous run
+  double checkpoint_period, checkpoint_max_age;
+  pnh.param("checkpoint_file", checkpoint_file_, std::string());
+  pnh.param("checkpoint_period", checkpoint_period, 1.0);
+  pnh.param("checkpoint_max_age", checkpoint_max_age, 5.0);
+
+  core_.reset(new TrackerCore(params, shared_map_, pool_));
+  core_->setPoseCallback([this] (const EFK::State& S, int64_t ts) { publishTrackedPose(S, ts); });
+  core_->setEventCallback([this] (const Event& e, bool used) { updateMapEvents(e, used); });
+  // reads the tuning parameters and applies them once, its topics and
+  // parameters are private like the other ones
+  reconfigure_server_.reset(new dynamic_reconfigure::Server<tracker::TrackerConfig>(pnh));
+  reconfigure_server_->setCallback(boost::bind(&Tracker::reconfigureCallback, this, _1, _2));
+  restored_calibration_ = !checkpoint_file_.empty() and restoreCheckpoint(checkpoint_max_age);
 
   // setup subscribers and publishers
   camera_info_sub_ = nh_.subscribe("camera_info", 1, &Tracker::cameraInfoCallback, this);
   starting_pose_sub_ = nh_.subscribe("camera_pose", 1, &Tracker::cameraPoseCallback, this);
   reset_sub_ = nh_.subscribe("reset", 1, &Tracker::resetCallback, this);
-  event_sub_ = nh_.subscribe("events", 10, &Tracker::eventsCallback, this);
+
+  // events have their own queue and thread, packets are held by pointer
+  // (zero-copy from a nodelet in the same manager) in a bounded backlog
+  int backlog;
+  pnh.param("event_backlog", backlog, 10);
+  max_backlog_ = std::max(1, backlog);
+  backlog_.resize(max_backlog_);
+  backlog_head_ = backlog_size_ = 0;
+  event_worker_running_ = true;
+  received_packets_ = dropped_packets_ = reported_received_ = reported_dropped_ = 0;
+  dropped_events_ = 0;
+  max_lag_ = 0;
+  event_worker_ = std::thread(&Tracker::processEvents, this);
+  ros::NodeHandle events_nh(nh_);
+  events_nh.setCallbackQueue(&events_queue_);
+  // the callback only queues the packet, this queue should never overflow
+  event_sub_ = events_nh.subscribe("events", 100, &Tracker::eventsCallback, this,
+                                   ros::TransportHints().tcpNoDelay());
+  packed_event_sub_ = events_nh.subscribe("packed_events", 100, &Tracker::packedEventsCallback, this,
+                                          ros::TransportHints().tcpNoDelay());
+  events_spinner_.reset(new ros::AsyncSpinner(1, &events_queue_));
+  events_spinner_->start();
+  backlog_report_timer_ = nh_.createWallTimer(ros::WallDuration(BACKLOG_REPORT_PERIOD),
+                                              &Tracker::backlogReportCallback, this);
+  // a shared map is loaded by its owner
+  if (own_map)
+    load_map_sub_ = nh_.subscribe("load_map", 1, &Tracker::loadMapCallback, this);
+  write_trace_sub_ = nh_.subscribe("write_trace", 1, &Tracker::writeTraceCallback, this);
+  get_pose_srv_ = nh_.advertiseService("get_pose", &Tracker::getPoseCallback, this);
 
   pose_pub_ = nh_.advertise<geometry_msgs::PoseStamped>("tracked_pose", 2, true);
+  if (has_extrinsics_)
+    body_pose_pub_ = nh_.advertise<geometry_msgs::PoseStamped>("tracked_body_pose", 2, true);
+  pose_msg_.header.frame_id = "map";
   image_transport::ImageTransport it_(nh_);
   map_events_pub_ = it_.advertise("map_events", 1);
+  map_events_msg_.height = IMAGE_HEIGHT;
+  map_events_msg_.width = IMAGE_WIDTH;
+  map_events_msg_.encoding = sensor_msgs::image_encodings::BGR8;
+  map_events_msg_.step = IMAGE_WIDTH*3;
+  map_events_msg_.data.resize(IMAGE_HEIGHT*IMAGE_WIDTH*3);
+  map_events_ = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC3, map_events_msg_.data.data());
+
+  if (!checkpoint_file_.empty() and checkpoint_period > 0)
+    checkpoint_timer_ = nh_.createWallTimer(ros::WallDuration(checkpoint_period),
+                                            &Tracker::checkpointCallback, this);
+
+  diagnostics_pub_ = nh_.advertise<diagnostic_msgs::DiagnosticArray>("/diagnostics", 1);
+  if (stats_period_ > 0)
+    stats_timer_ = nh_.createWallTimer(ros::WallDuration(stats_period_), &Tracker::statsCallback, this);
 }
 
 Tracker::~Tracker() {
+    // stop the event path first, it uses everything else
+    event_sub_.shutdown();
+    packed_event_sub_.shutdown();
+    events_spinner_->stop();
+    {
+        std::lock_guard<std::mutex> lock(backlog_mutex_);
+        event_worker_running_ = false;
+    }
+    backlog_cond_.notify_one();
+    event_worker_.join();
+
+    // totals since startup
+    stats_timer_.stop();
+    TrackerStats stats;
+    collectStats(stats);
+    total_stats_.merge(stats);
+    std::ostringstream report;
+    total_stats_.report(report);
+    ROS_INFO_STREAM("event path statistics:\n" << report.str());
+    if (!stats_file_.empty()) {
+        std::ofstream file(stats_file_);
+        file << report.str();
+        if (!file) ROS_ERROR_STREAM("cannot write statistics to " << stats_file_);
+    }
+    if (!trace_file_.empty()) writeTrace(trace_file_);
+    // the last state, for a restart or a nodelet reload
+    checkpoint_timer_.stop();
+    if (!checkpoint_file_.empty()) writeCheckpoint();
+
+    reconfigure_server_.reset();
+    get_pose_srv_.shutdown();
     pose_pub_.shutdown();
     map_events_pub_.shutdown();
+    core_.reset();
 }
 
 void Tracker::cameraInfoCallback(const sensor_msgs::CameraInfo::ConstPtr& msg) {
+    std::lock_guard<std::mutex> lock(mutex_);
     ROS_INFO("got camera info");
     // K is row-major matrix
-    camera_matrix_ << msg->K[2], msg->K[5], msg->K[0], msg->K[4];
-
-    camera_matrix_cv = cv::Mat(3, 3, CV_64F);
-    for (int i = 0; i < 3; i++)
-        for (int j = 0; j < 3; j++)
-            camera_matrix_cv.at<double>(cv::Point(i, j)) = msg->K[i+j*3];
-
-    dist_coeffs_cv = cv::Mat(msg->D.size(), 1, CV_64F);
-    for (int i = 0; i < msg->D.size(); i++)
-        dist_coeffs_cv.at<double>(i) = msg->D[i];
-
-    if (msg->D[2] != 0.0 or msg->D[3] != 0.0)
-        ROS_ERROR("Non zero tangencial distortion coeffs !!");
-
-    ROS_DEBUG_STREAM("camera matrix: \n" << camera_matrix_cv << "\n dist coeffs: \n" << dist_coeffs_cv);
+    Vec4 camera_matrix;
+    camera_matrix << msg->K[2], msg->K[5], msg->K[0], msg->K[4];
+    ROS_DEBUG_STREAM("camera matrix: " << camera_matrix.transpose() << "\n dist coeffs: " <<
+        Eigen::Map<const Eigen::VectorXd>(msg->D.data(), msg->D.size()).transpose());
     camera_info_sub_.shutdown();
-
-    // compute undistort coeffs -> read Tracker::undistortEvent doc
-    double k1 = msg->D[0];
-    double k2 = msg->D[1];
-    double k3 = msg->D[4];
-    undist_coeffs << -k1,
-                     3*k1*k1 - k2,
-                     8*k1*k2 - 12*k1*k1*k1 - k3;
-
-    got_camera_info_ = true;
-    
+    if (restored_calibration_) {
+        // already tracking with the calibration of the checkpoint
+        if (camera_matrix == core_->getCameraMatrix() and msg->D == core_->getDistortion()) {
+            ROS_INFO("camera info matches the calibration of the checkpoint");
+            return;
+        }
+        ROS_WARN("camera info differs from the calibration of the checkpoint, using the camera info");
+    }
+    core_->setCalibration(camera_matrix, msg->D);
 }
 
 void Tracker::cameraPoseCallback(const geometry_msgs::PoseStamped::ConstPtr& msg) {
-    if (!got_camera_pose_) ROS_INFO("got camera pose");
-    got_camera_pose_ = true;
-    camera_position_ = Vec3(msg->pose.position.x,
-                                 msg->pose.position.y,
-                                 msg->pose.position.z);
-    camera_orientation_ = Quaternion(msg->pose.orientation.w,
+    TRACK_TRACE_SCOPE("camera pose");
+    std::lock_guard<std::mutex> lock(mutex_);
+    ROS_INFO_ONCE("got camera pose");
+    core_->setCameraPose(Vec3(msg->pose.position.x,
+                              msg->pose.position.y,
+                              msg->pose.position.z),
+                         Quaternion(msg->pose.orientation.w,
                                     msg->pose.orientation.x,
                                     msg->pose.orientation.y,
-                                    msg->pose.orientation.z);
-    ROS_DEBUG_STREAM("got pose " << camera_position_ << " and orientation " << camera_orientation_.coeffs());
+                                    msg->pose.orientation.z),
+                         msg->header.stamp.toNSec());
 }
 
 void Tracker::resetCallback(const std_msgs::Bool::ConstPtr& msg) {
+    TRACK_TRACE_SCOPE("reset");
+    std::lock_guard<std::mutex> lock(mutex_);
     ROS_INFO("received reset callback!");
-    is_tracking_running_ = false;
+    event_counter_ = 0;
+    core_->start();
+}
 
-    // create initial state from last camera pose
-    EFK::State X0;
-    X0.r = camera_position_;
-    X0.q = camera_orientation_;
-    X0.v = Vec3::Zero();
-    X0.w = AngleAxis(0, Vec3::UnitZ());
-    efk_.init(X0);
+void Tracker::eventsCallback(const dvs_msgs::EventArray::ConstPtr& msg) {
+    queuePacket(Packet { msg, tracker::PackedEventArray::ConstPtr() });
+}
 
-    // reset time
-    last_event_ts = ros::Time(0);
+void Tracker::packedEventsCallback(const tracker::PackedEventArray::ConstPtr& msg) {
+    queuePacket(Packet { dvs_msgs::EventArray::ConstPtr(), msg });
+}
 
-    // reset counter
-    event_counter_ = 0;
+void Tracker::queuePacket(const Packet& packet) {
+    TRACK_TRACE_SCOPE_ARG("queue packet", packetSize(packet));
+    {
+        std::lock_guard<std::mutex> lock(backlog_mutex_);
+        ++received_packets_;
+        if (backlog_size_ == max_backlog_) {
+            // tracking is late, old packets are worth less than new ones
+            dropped_events_ += packetSize(backlog_[backlog_head_]);
+            backlog_head_ = (backlog_head_ + 1) % max_backlog_;
+            --backlog_size_;
+            ++dropped_packets_;
+        }
+        backlog_[(backlog_head_ + backlog_size_) % max_backlog_] = packet;
+        ++backlog_size_;
+    }
+    backlog_cond_.notify_one();
+}
+
+void Tracker::processEvents() {
+    TRACK_TRACE_THREAD("event worker");
+    while (true) {
+        Packet packet;
+        {
+            std::unique_lock<std::mutex> lock(backlog_mutex_);
+            backlog_cond_.wait(lock, [this] { return !event_worker_running_ or backlog_size_ > 0; });
+            if (!event_worker_running_) return;
+            // the message is released with packet, not by the ring
+            std::swap(packet, backlog_[backlog_head_]);
+            backlog_head_ = (backlog_head_ + 1) % max_backlog_;
+            --backlog_size_;
+        }
+        TRACK_TRACE_SCOPE_ARG("packet", packetSize(packet));
+        std::unique_lock<std::mutex> lock(mutex_, std::defer_lock);
+        {
+            // held by the control callbacks and the stats collection
+            TRACK_TRACE_SCOPE("wait tracker lock");
+            lock.lock();
+        }
+        if (!decodePacket(packet)) continue;
+        {
+            std::lock_guard<std::mutex> lock(backlog_mutex_);
+            max_lag_ = std::max(max_lag_, (int64_t(ros::Time::now().toNSec()) - batch_.back().ts)*1e-9);
+        }
+        core_->processEvents(batch_);
+    }
+}
 
-    // project map
-    map_.projectAll(camera_position_, camera_orientation_, camera_matrix_);
+bool Tracker::restoreCheckpoint(double max_age) {
+    Checkpoint checkpoint;
+    if (!readCheckpoint(checkpoint_file_, checkpoint)) {
+        ROS_INFO_STREAM("no checkpoint to resume from in " << checkpoint_file_);
+        return false;
+    }
+    double age = (int64_t(ros::WallTime::now().toNSec()) - checkpoint.written)*1e-9;
+    if (age > max_age or checkpoint.D.size() < 5) {
+        ROS_INFO_STREAM("checkpoint " << checkpoint_file_ << " is " << age << " s old, not resumed");
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    core_->restore(checkpoint);
+    ROS_INFO_STREAM("resumed tracking from a checkpoint " << age*1e3 << " ms old at " <<
+        checkpoint.X.r.transpose());
+    return true;
+}
 
-    // put flag at then so that efk is initialized
-    is_tracking_running_ = true;
+void Tracker::writeCheckpoint() {
+    Checkpoint checkpoint;
+    {
+        // a copy of the filter, the file is written without the lock
+        TRACK_TRACE_SCOPE("checkpoint");
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!core_->getCheckpoint(checkpoint)) return;
+    }
+    checkpoint.written = ros::WallTime::now().toNSec();
+    if (!track::writeCheckpoint(checkpoint_file_, checkpoint))
+        ROS_ERROR_STREAM_THROTTLE(10, "cannot write checkpoint to " << checkpoint_file_);
 }
 
-void Tracker::eventsCallback(const dvs_msgs::EventArray::ConstPtr& msg) {
-    ROS_DEBUG("got an event array of size %lu", msg->events.size());
-    if (!(is_tracking_running_ and got_camera_pose_ and got_camera_info_)) return;
-    // handle variable amount of events, this is STUPID, EASY and NOT ADAPTATIVE !!!
-    const uint EVENT_MAX_SIZE = 2000;
-    uint increment = msg->events.size() / EVENT_MAX_SIZE + 1;
-
-    for (int i = 0; i < msg->events.size(); i += increment) {
-        const dvs_msgs::Event &e = msg->events[i];
-        Tracker::Event event { Point2d(e.x, e.y), e.ts };
-        // undistort event
-        undistortEvent(event);
-        handleEvent(event);
+void Tracker::checkpointCallback(const ros::WallTimerEvent& event) {
+    writeCheckpoint();
+}
+
+void Tracker::reconfigureCallback(tracker::TrackerConfig& config, uint32_t level) {
+    TRACK_TRACE_SCOPE("reconfigure");
+    std::lock_guard<std::mutex> lock(mutex_);
+    TrackerCore::Tuning tuning;
+    tuning.sigma_v = Vec3::Constant(config.sigma_v);
+    tuning.sigma_w = Vec3::Constant(config.sigma_w);
+    tuning.sigma_d = config.sigma_d;
+    tuning.matching_threshold = config.matching_threshold;
+    tuning.matching_margin = config.matching_margin;
+    tuning.event_max_size = std::max(0, config.event_max_size);
+    core_->setTuning(tuning);
+    publish_map_events_rate_ = std::max(0, config.publish_map_events_rate);
+    // the largest batch, kept by batch_ once reached when unbounded
+    if (tuning.event_max_size > 0) batch_.reserve(tuning.event_max_size);
+    ROS_INFO_STREAM("tuning: sigma_v " << config.sigma_v << ", sigma_w " << config.sigma_w <<
+        ", sigma_d " << config.sigma_d << ", matching " << config.matching_threshold << " px margin " <<
+        config.matching_margin << " px, " << tuning.event_max_size << " events per packet");
+}
+
+void Tracker::backlogReportCallback(const ros::WallTimerEvent& event) {
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    uint64_t received = received_packets_ - reported_received_;
+    uint64_t dropped = dropped_packets_ - reported_dropped_;
+    if (dropped > 0)
+        ROS_WARN_STREAM("event backlog full: dropped " << dropped << " of " << received <<
+            " packets, max lag " << max_lag_*1e3 << " ms, " << dropped_packets_ << " dropped in total");
+    else
+        ROS_DEBUG_STREAM("event backlog: " << received << " packets, " << backlog_size_ <<
+            " queued, max lag " << max_lag_*1e3 << " ms");
+    reported_received_ = received_packets_;
+    reported_dropped_ = dropped_packets_;
+    max_lag_ = 0;
+}
+
+bool Tracker::decodePacket(const Packet& packet) {
+    TrackerStats& stats = core_->getStats();
+    TrackerStats::Timer timer(stats, TrackerStats::Conversion);
+    TRACK_TRACE_SCOPE_ARG("conversion", packetSize(packet));
+    batch_.clear();
+    if (packet.events) {
+        ROS_DEBUG("got an event array of size %lu", packet.events->events.size());
+        toBatch(*packet.events, batch_, core_->getTuning().event_max_size);
+    } else {
+        ROS_DEBUG("got a packed event array of size %u", packet.packed->count);
+        toBatch(*packet.packed, batch_, core_->getTuning().event_max_size);
+    }
+    size_t size = packetSize(packet);
+    stats.add(TrackerStats::Received, size);
+    stats.add(TrackerStats::Subsampled, size - batch_.size());
+    return !batch_.empty();
+}
+
+size_t Tracker::packetSize(const Packet& packet) {
+    return packet.events ? packet.events->events.size() : packet.packed->count;
+}
+
+void Tracker::collectStats(TrackerStats& stats) {
+    TRACK_TRACE_SCOPE("collect stats");
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stats = core_->getStats();
+        core_->getStats().clear();
     }
+    std::lock_guard<std::mutex> lock(backlog_mutex_);
+    stats.add(TrackerStats::Dropped, dropped_events_);
+    dropped_events_ = 0;
 }
 
-void Tracker::publishTrackedPose(const EFK::State& S) {
+void Tracker::statsCallback(const ros::WallTimerEvent& event) {
+    TrackerStats stats;
+    collectStats(stats);
+    total_stats_.merge(stats);
+
+    diagnostic_msgs::DiagnosticStatus status;
+    status.name = nh_.getNamespace() + " tracker: event path";
+    uint64_t received = stats.get(TrackerStats::Received);
+    uint64_t dropped = stats.get(TrackerStats::Dropped);
+    uint64_t matched = stats.get(TrackerStats::Matched);
+    uint64_t associated = matched + stats.get(TrackerStats::Rejected);
+    std::ostringstream message;
+    message << std::fixed << std::setprecision(0) << received/stats_period_ << " events/s, " <<
+        (associated ? 100.0*matched/associated : 0) << "% matched";
+    if (dropped > 0) message << ", " << dropped << " dropped";
+    status.message = message.str();
+    status.level = dropped > 0 ? diagnostic_msgs::DiagnosticStatus::WARN : diagnostic_msgs::DiagnosticStatus::OK;
+    for (int i = 0; i < TrackerStats::COUNTERS; ++i) {
+        TrackerStats::Counter counter = TrackerStats::Counter(i);
+        status.values.push_back(keyValue(TrackerStats::counterName(counter),
+                                         std::to_string(stats.get(counter))));
+    }
+    for (int i = 0; i < TrackerStats::STAGES; ++i) {
+        TrackerStats::Stage stage = TrackerStats::Stage(i);
+        if (stats.get(stage).count() == 0) continue;
+        status.values.push_back(keyValue(std::string(TrackerStats::stageName(stage)) +
+                                         " mean p50 p90 p99 max (us)", formatLatency(stats.get(stage))));
+    }
+
+    diagnostic_msgs::DiagnosticArray msg;
+    msg.header.stamp = ros::Time::now();
+    msg.status.push_back(status);
+    diagnostics_pub_.publish(msg);
+}
+
+void Tracker::loadMapCallback(const std_msgs::String::ConstPtr& msg) {
+    shared_map_->loadAsync(msg->data);
+}
+
+void Tracker::writeTraceCallback(const std_msgs::String::ConstPtr& msg) {
+    writeTrace(msg->data);
+}
+
+void Tracker::writeTrace(const std::string& path) {
+    if (!trace::enabled()) {
+        ROS_WARN_STREAM("no trace to write, build with -DTRACING=ON to record one");
+        return;
+    }
+    if (trace::write(path)) ROS_INFO_STREAM("trace written to " << path);
+    else ROS_ERROR_STREAM("cannot write trace to " << path);
+}
+
+void Tracker::publishTrackedPose(const EFK::State& S, int64_t ts) {
     ROS_DEBUG("publishing tracker pose");
+    TrackerStats& stats = core_->getStats();
+    TrackerStats::Timer timer(stats, TrackerStats::Publish);
 
-    geometry_msgs::PoseStamped poseStamped;
+    geometry_msgs::PoseStamped& poseStamped = pose_msg_;
 
-    poseStamped.header.frame_id="map";
     poseStamped.header.stamp = ros::Time::now();
+    // events are stamped by the driver with the same clock
+    int64_t latency = int64_t(poseStamped.header.stamp.toNSec()) - ts;
+    if (latency >= 0) stats.record(TrackerStats::EndToEnd, uint64_t(latency));
 
     poseStamped.pose.position.x = S.r[0];
     poseStamped.pose.position.y = S.r[1];
@@ -143,14 +491,52 @@ void Tracker::publishTrackedPose(const EFK::State& S) {
     poseStamped.pose.orientation.w = S.q.w();
 
     pose_pub_.publish(poseStamped);
+
+    if (has_extrinsics_) {
+        // T_map_body = T_map_cam * inverse(T_body_cam)
+        Quaternion q_body = S.q * body_q_cam_.conjugate();
+        Vec3 r_body = S.r - q_body * body_t_cam_;
+        poseStamped.pose.position.x = r_body[0];
+        poseStamped.pose.position.y = r_body[1];
+        poseStamped.pose.position.z = r_body[2];
+        poseStamped.pose.orientation.x = q_body.x();
+        poseStamped.pose.orientation.y = q_body.y();
+        poseStamped.pose.orientation.z = q_body.z();
+        poseStamped.pose.orientation.w = q_body.w();
+        body_pose_pub_.publish(poseStamped);
+    }
 }
 
+bool Tracker::getPoseCallback(tracker::GetPose::Request& req, tracker::GetPose::Response& res) {
+    // core_ is only replaced in the destructor, the history is lock free
+    EFK::State S;
+    res.success = core_->getPoseHistory().get(req.stamp.toNSec(), S);
+    if (!res.success) return true;
+    res.pose.header.stamp = req.stamp;
+    res.pose.header.frame_id = "map";
+    res.pose.pose.position.x = S.r[0];
+    res.pose.pose.position.y = S.r[1];
+    res.pose.pose.position.z = S.r[2];
+    res.pose.pose.orientation.x = S.q.x();
+    res.pose.pose.orientation.y = S.q.y();
+    res.pose.pose.orientation.z = S.q.z();
+    res.pose.pose.orientation.w = S.q.w();
+    Vec3 w = S.w.angle()*S.w.axis();
+    res.twist.linear.x = S.v[0];
+    res.twist.linear.y = S.v[1];
+    res.twist.linear.z = S.v[2];
+    res.twist.angular.x = w[0];
+    res.twist.angular.y = w[1];
+    res.twist.angular.z = w[2];
+    return true;
+}
 
 void Tracker::updateMapEvents(const Tracker::Event &e, bool used) {
+    if (publish_map_events_rate_ == 0) return;
     // publish map with event
     // get projected map
     if (event_counter_ == 0)
-        map_events_ = cv::Mat(IMAGE_HEIGHT, IMAGE_WIDTH, CV_8UC3, cv::Scalar(0,0,0));
+        map_events_.setTo(cv::Scalar(0,0,0));
     // add event red if used, grey if not
     // event is a float !!!
     cv::Point event_point(round(e.p[0]), round(e.p[1]));
@@ -164,14 +550,14 @@ void Tracker::updateMapEvents(const Tracker::Event &e, bool used) {
         
     event_counter_++;
 
-    if (event_counter_ == PUBLISH_MAP_EVENTS_RATE) {
-        //map_.draw2dMap(map_events_);
-        map_.draw2dMapWithCov(map_events_, efk_.getCovariance().block<7,7>(0,0));
-        // convert and publish tracked map
-        cv_bridge::CvImage cv_image;
-        map_events_.copyTo(cv_image.image);
-        cv_image.encoding = "bgr8";
-        map_events_pub_.publish(cv_image.toImageMsg());
+    if (event_counter_ >= publish_map_events_rate_) {
+        TrackerStats::Timer timer(core_->getStats(), TrackerStats::Visualization);
+        TRACK_TRACE_SCOPE("visualization");
+        //core_->getMap().draw2dMap(map_events_);
+        core_->getMap().draw2dMapWithCov(map_events_, core_->getCovariance().block<7,7>(0,0));
+        // publish tracked map, drawn in the message buffer
+        map_events_msg_.header.stamp = ros::Time::now();
+        map_events_pub_.publish(map_events_msg_);
         // display with pause
         //     cv::imshow("map events", map_events_);
         //     cv::waitKey(0);
@@ -180,94 +566,4 @@ void Tracker::updateMapEvents(const Tracker::Event &e, bool used) {
     }
 }
 
-void displayState(EFK::State S) {
-    ROS_DEBUG_STREAM(" state:\n" <<
-        "\tr: " << S.r.transpose() << '\n' <<
-        "\tq: " << S.q.coeffs().transpose() << '\n' <<
-        "\tv: " << S.v.transpose() << '\n' <<
-        "\tw: " << S.w.angle() << " :: " << S.w.axis().transpose()
-    );
-}
-
-
-void Tracker::handleEvent(const Tracker::Event &e) {
-    if (last_event_ts.isZero()) { // first event
-        last_event_ts = e.ts;
-        return;
-    }
-    // predict
-    double dt = (e.ts - last_event_ts).toSec();
-    if (dt > 1e-2) ROS_WARN_STREAM("huge dt " << dt);
-    else if (dt > 1e-4) ROS_DEBUG_STREAM("big dt " << dt);
-    
-    last_event_ts = e.ts;
-    // ROS_DEBUG("##############################");
-    ROS_DEBUG_STREAM("### EVENT " << e.p << " dt = " << dt);
-    // ROS_DEBUG_STREAM("P diagonal" << efk_.getCovariance().diagonal().transpose());
-    // ROS_DEBUG("# before prediction");
-    // displayState(efk_.getState());
-    efk_.predict(dt);
-    // ROS_DEBUG("# after prediction");
-    // displayState(efk_.getState());
-
-    // associate event to a segment in projected map
-    double dist;
-    const int segmentId = map_.getNearest(e.p, dist, MATCHING_DIST_THRESHOLD, MATCHING_DIST_MIN_MARGIN);
-    
-    ROS_DEBUG_STREAM("event is at distance " << dist << ", segment " << segmentId);
-
-    // no segment matched
-    if (segmentId < 0) {
-        updateMapEvents(e);
-        return; // skip event
-    }
-
-    // update image of events and projected map
-    updateMapEvents(e, true);
-
-    // reproject associated segment
-    EFK::State S = efk_.getState();
-    map_.project(segmentId, S.r, S.q, camera_matrix_);
-    // DEBUG PROJECTING ALL
-    //map_.projectAll(S.r, S.q, camera_matrix_);
-
-    // compute measurement (distance) and jacobian
-    Eigen::RowVector3d jac_d_r;
-    Eigen::RowVector4d jac_d_q;
-    dist = map_.getDistance(e.p, segmentId, jac_d_r, jac_d_q);
-    Eigen::Matrix<double, 1, 7> jac_d_pose;
-    jac_d_pose << jac_d_r, jac_d_q;
-    
-    // update state in efk
-    efk_.update(dist, jac_d_pose);
-    // ROS_DEBUG("# after update");
-    // displayState(efk_.getState());
-    publishTrackedPose(efk_.getState());
-}
-
-
-void Tracker::undistortEvent(Tracker::Event &e) {
-    ROS_DEBUG_STREAM("before undistort: " << e.p.transpose());
-    // using the first 3 terms of the exact inverse distortion model (only radial)
-    // https://www.ncbi.nlm.nih.gov/pmc/articles/PMC4934233/
-    // distortion is r *= 1 + k1*r^2 + k2*r^4 + k3*r^6
-    // undistortion is s *= 1 + (-k1)*s^2 + (3k1^2 - k2)*s^4 + (8k1k2 - 12k1^3 - k3)*s^6
-    double u0 = camera_matrix_[0];
-    double u1 = camera_matrix_[1];
-    double fx = camera_matrix_[2];
-    double fy = camera_matrix_[3];
-    e.p[0] = (e.p[0] - u0)/fx;
-    e.p[1] = (e.p[1] - u1)/fy;
-
-    double s2 = e.p.squaredNorm();
-    double s4 = s2*s2;
-    double s6 = s4*s2;
-    double undist_factor = 1 + undist_coeffs.dot(Vec3(s2,s4,s6));
-    e.p *= undist_factor;
-
-    e.p[0] = e.p[0]*fx + u0;
-    e.p[1] = e.p[1]*fy + u1;
-    ROS_DEBUG_STREAM("after undistort: " << e.p.transpose());
-}
-
 } // namespace
@@ -0,0 +1,545 @@
+#include "tracker/tracker_core.h"
+#include "tracker/trace.h"
+#include <thread>
+#include <chrono>
+
+namespace track
+{
+
+TrackerCore::TrackerCore(const Params& params, const std::shared_ptr<SharedMap>& map,
+                         const std::shared_ptr<ThreadPool>& pool) :
+    shared_map_(map), map_building_(false), history_(PoseHistory::Params()), pool_(pool),
+    stats_(params.stats_sampling) {
+  got_camera_info_ = false;
+  got_camera_pose_ = false;
+  is_tracking_running_ = false;
+  waiting_fresh_pose_ = false;
+  has_good_state_ = false;
+  measurement_dt_ = 0;
+  last_event_ts = 0;
+  diverged_ts_ = 0;
+  last_relocalization_ts_ = 0;
+  auto_reset_ = params.auto_reset;
+  time_event_ = false;
+  auto_start_ = params.auto_start;
+  started_ = false;
+  start_poses_ = std::max(1, params.start_poses);
+  consistent_poses_ = 0;
+  start_buffer_duration_ = int64_t(params.start_buffer*1e9);
+  start_head_ = start_size_ = 0;
+  replay_pending_ = false;
+  replay_from_ = 0;
+
+  map_version_ = shared_map_->getVersion();
+  map_ = std::make_shared<TrackerMap>(*shared_map_->getSegments());
+
+  if (params.relocalization)
+    relocalizer_.reset(new Relocalizer(Relocalizer::Params(), *pool_));
+  if (params.idle_mode)
+    idle_.reset(new IdleDetector());
+  last_batch_ts_ = 0;
+
+  // run more filters with other noise settings in the pool
+  if (params.hypotheses > 1) {
+    MultiHypothesis::Params hypotheses_params;
+    hypotheses_params.hypotheses = params.hypotheses;
+    hypotheses_.reset(new MultiHypothesis(hypotheses_params,
+        tuning_.sigma_v, tuning_.sigma_w, tuning_.sigma_d, *pool_));
+  }
+
+  // refine the filter over the last packets in the pool
+  if (params.smoothing) {
+    smoother_.reset(new FixedLagSmoother(FixedLagSmoother::Params(), *pool_));
+    smoother_measurements_.reserve(EVENT_MAX_SIZE);
+  }
+
+  // grow the (shared) map from unmatched events
+  if (params.mapping) {
+    std::shared_ptr<SharedMap> shared_map = shared_map_;
+    mapper_.reset(new LineMapper(LineMapper::Params(), shared_map,
+        [shared_map] (const vector<SlamLine>& segments) {
+            shared_map->appendSegments(segments);
+            TRACK_INFO_STREAM("mapping added " << segments.size() << " segments");
+        }));
+  }
+
+  efk_ = EFK(tuning_.sigma_v, tuning_.sigma_w, tuning_.sigma_d);
+}
+
+TrackerCore::~TrackerCore() {
+    mapper_.reset(); // stop mapping before the maps go away
+    hypotheses_.reset();
+    smoother_.reset();
+    // a map may still be built in the pool
+    while (map_building_) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void TrackerCore::setCalibration(const Vec4& K, const vector<double>& D) {
+    camera_matrix_ = K;
+    distortion_ = D;
+
+    if (D[2] != 0.0 or D[3] != 0.0)
+        TRACK_ERROR_STREAM("Non zero tangencial distortion coeffs !!");
+
+    // compute undistort coeffs -> read TrackerCore::undistortEvent doc
+    double k1 = D[0];
+    double k2 = D[1];
+    double k3 = D[4];
+    undist_coeffs << -k1,
+                     3*k1*k1 - k2,
+                     8*k1*k2 - 12*k1*k1*k1 - k3;
+
+    if (mapper_) mapper_->setCameraMatrix(camera_matrix_);
+    got_camera_info_ = true;
+}
+
+void TrackerCore::setCameraPose(const Vec3& r, const Quaternion& q, int64_t stamp) {
+    // track_init is trusted once it gives the same pose a few times in a row
+    if (got_camera_pose_ and (r - camera_position_).norm() < START_MAX_POSITION_CHANGE and
+        q.angularDistance(camera_orientation_) < START_MAX_ANGLE_CHANGE) ++consistent_poses_;
+    else consistent_poses_ = 1;
+    got_camera_pose_ = true;
+    camera_position_ = r;
+    camera_orientation_ = q;
+    TRACK_DEBUG_STREAM("got pose " << camera_position_ << " and orientation " << camera_orientation_.coeffs());
+
+    // recover from divergence with the first pose computed after it
+    if (waiting_fresh_pose_ and stamp > diverged_ts_) {
+        TRACK_INFO_STREAM("got a fresh camera pose, resetting tracker");
+        reset(camera_position_, camera_orientation_);
+    }
+
+    // start from it and track the events received since its time
+    if (auto_start_ and !started_ and got_camera_info_ and consistent_poses_ >= start_poses_) {
+        TRACK_INFO_STREAM("starting automatically after " << consistent_poses_ << " consistent camera poses");
+        reset(camera_position_, camera_orientation_);
+        replay_pending_ = true;
+        replay_from_ = stamp;
+    }
+}
+
+void TrackerCore::start() {
+    reset(camera_position_, camera_orientation_);
+    // started by hand, the events buffered for the auto start are dropped
+    replay_pending_ = false;
+    vector<Event>().swap(start_buffer_);
+    start_head_ = start_size_ = 0;
+}
+
+void TrackerCore::setTuning(const Tuning& tuning) {
+    tuning_ = tuning;
+    // the main filter may run the noise of a selected hypothesis
+    double scale = hypotheses_ ? hypotheses_->getScale(hypotheses_->getSelected()) : 1;
+    efk_.setNoise(scale*tuning_.sigma_v, scale*tuning_.sigma_w, tuning_.sigma_d);
+    if (hypotheses_) hypotheses_->setNoise(tuning_.sigma_v, tuning_.sigma_w, tuning_.sigma_d);
+    if (smoother_) smoother_->init(camera_matrix_, tuning_.sigma_d);
+}
+
+bool TrackerCore::getCheckpoint(Checkpoint& checkpoint) {
+    // a diverging filter is not worth resuming
+    if (!(got_camera_info_ and is_tracking_running_ and last_event_ts != 0 and monitor_.isGood()))
+        return false;
+    checkpoint.X = efk_.getState();
+    checkpoint.P = efk_.getCovariance();
+    checkpoint.K = camera_matrix_;
+    checkpoint.D = distortion_;
+    checkpoint.last_event_ts = last_event_ts;
+    return true;
+}
+
+void TrackerCore::restore(const Checkpoint& checkpoint) {
+    setCalibration(checkpoint.K, checkpoint.D);
+    got_camera_pose_ = true;
+    camera_position_ = checkpoint.X.r;
+    camera_orientation_ = checkpoint.X.q;
+    // relocalize around it if it went stale meanwhile
+    last_good_state_ = checkpoint.X;
+    has_good_state_ = true;
+    reset(checkpoint.X, checkpoint.P);
+}
+
+void TrackerCore::reset(const Vec3& r, const Quaternion& q) {
+    // create initial state from camera pose
+    EFK::State X0;
+    X0.r = r;
+    X0.q = q;
+    X0.v = Vec3::Zero();
+    X0.w = AngleAxis(0, Vec3::UnitZ());
+    reset(X0, Mat13::Zero());
+}
+
+void TrackerCore::reset(const EFK::State& X0, const Mat13& P0) {
+    is_tracking_running_ = false;
+    waiting_fresh_pose_ = false;
+    started_ = true;
+
+    efk_ = EFK(tuning_.sigma_v, tuning_.sigma_w, tuning_.sigma_d); // a hypothesis may have changed the noise
+    efk_.init(X0, P0);
+    if (hypotheses_) {
+        hypotheses_->init(X0, camera_matrix_);
+        measurements_.clear();
+        measurement_dt_ = 0;
+    }
+    if (smoother_) {
+        smoother_->init(camera_matrix_, tuning_.sigma_d);
+        smoother_measurements_.clear();
+    }
+
+    // reset time
+    last_event_ts = 0;
+    // no interpolation across a reset
+    history_.clear();
+
+    monitor_.reset();
+    if (idle_) idle_->reset();
+
+    // project map
+    swapMap();
+    map_->projectAll(X0.r, X0.q, camera_matrix_);
+
+    // put flag at then so that efk is initialized
+    is_tracking_running_ = true;
+}
+
+void TrackerCore::processEvents(vector<Event>& events) {
+    if (auto_start_ and !started_) {
+        bufferEvents(events);
+        return;
+    }
+    // events are still needed to relocalize while waiting for a fresh pose
+    bool relocalizing = relocalizer_ and waiting_fresh_pose_;
+    if (!(got_camera_info_ and ((is_tracking_running_ and got_camera_pose_) or relocalizing))) return;
+    if (events.empty()) return;
+    if (replay_pending_) replayBuffer(events.front().ts);
+    TrackerStats::Timer timer(stats_, TrackerStats::Packet);
+    TRACK_TRACE_SCOPE_ARG("core packet", events.size());
+    // events per second since the previous batch
+    int64_t first_ts = last_batch_ts_ != 0 and last_batch_ts_ < events.back().ts ?
+        last_batch_ts_ : events.front().ts;
+    double rate = events.back().ts > first_ts ? events.size()/((events.back().ts - first_ts)*1e-9) : 1e9;
+    last_batch_ts_ = events.back().ts;
+    // the whole batch is associated against the same map
+    {
+        TRACK_TRACE_SCOPE("update map");
+        updateMap();
+    }
+    if (is_tracking_running_ and isIdle() and !checkIdle(events, rate)) return;
+    // adopt the best hypothesis of the previous batches
+    if (is_tracking_running_ and hypotheses_ and hypotheses_->select(efk_))
+        TRACK_DEBUG_STREAM("switched to hypothesis " << hypotheses_->getSelected() <<
+            " noise scale " << hypotheses_->getScale(hypotheses_->getSelected()));
+    // the smoother refines the filter from before the batch
+    bool smoothing = is_tracking_running_ and smoother_ and last_event_ts != 0;
+    if (smoothing) smoother_->correct(efk_, history_);
+    EFK::State X0;
+    Mat13 P0;
+    int64_t ts0 = last_event_ts;
+    if (smoothing) {
+        X0 = efk_.getState();
+        P0 = efk_.getCovariance();
+    }
+    {
+        TRACK_TRACE_SCOPE_ARG("track events", events.size());
+        for (Event& event : events) {
+            time_event_ = stats_.sample();
+            // undistort event
+            {
+                TrackerStats::Timer timer(stats_, TrackerStats::Undistortion, time_event_);
+                undistortEvent(event);
+            }
+            if (relocalizer_) relocalizer_->addEvent(event.p, event.ts*1e-9);
+            if (is_tracking_running_) handleEvent(event);
+        }
+    }
+
+    if (!is_tracking_running_) {
+        TRACK_TRACE_SCOPE("relocalize");
+        relocalize(events.back().ts);
+        return;
+    }
+    // the latest state, extrapolated by the history queries
+    if (last_event_ts != 0) history_.add(efk_.getState(), last_event_ts, true);
+    // the hypotheses follow in background while the next batch arrives
+    if (hypotheses_) {
+        TRACK_TRACE_SCOPE_ARG("hypotheses", measurements_.size());
+        hypotheses_->process(measurements_);
+    }
+    if (smoother_) {
+        if (smoothing) {
+            TRACK_TRACE_SCOPE_ARG("smoother", smoother_measurements_.size());
+            smoother_->process(X0, P0, ts0, smoother_measurements_, last_event_ts);
+        }
+        smoother_measurements_.clear();
+    }
+
+    // check tracking quality once per batch
+    if (monitor_.check(efk_.getState(), efk_.getCovariance())) {
+        const TrackingMonitor::Health& h = monitor_.getHealth();
+        TRACK_WARN_STREAM("tracking lost: association ratio " << h.association_ratio <<
+            ", mean NIS " << h.mean_nis << ", trace P_rr " << h.position_trace <<
+            ", trace P_qq " << h.orientation_trace);
+        is_tracking_running_ = false;
+        if (auto_reset_) {
+            TRACK_INFO_STREAM("waiting for a fresh camera pose to reset");
+            waiting_fresh_pose_ = true;
+            // event time, so that it also holds when replaying faster than real time
+            diverged_ts_ = events.back().ts;
+            if (relocalizer_) relocalize(events.back().ts);
+        }
+    } else if (monitor_.isGood()) {
+        last_good_state_ = efk_.getState();
+        has_good_state_ = true;
+    }
+
+    if (is_tracking_running_ and idle_ and idle_->checkStill(rate, efk_.getState())) {
+        TRACK_INFO_STREAM("camera still, idle at " << rate << " events/s");
+        freeze();
+    }
+}
+
+void TrackerCore::freeze() {
+    EFK::State S = efk_.getState();
+    S.v = Vec3::Zero();
+    S.w = AngleAxis(0, Vec3::UnitZ());
+    efk_.init(S, efk_.getCovariance());
+    if (hypotheses_) {
+        hypotheses_->init(S, camera_matrix_);
+        measurements_.clear();
+        measurement_dt_ = 0;
+    }
+    if (smoother_) smoother_->init(camera_matrix_, tuning_.sigma_d);
+    if (last_event_ts != 0) history_.add(S, last_event_ts, true);
+}
+
+bool TrackerCore::checkIdle(const vector<Event>& events, double rate) {
+    TRACK_TRACE_SCOPE_ARG("idle", events.size());
+    // a few events are enough to see the edges of the map fire again
+    uint matched = 0, associated = 0;
+    for (size_t i = 0; i < events.size(); i += idle_->getSubsampling()) {
+        Event e = events[i];
+        undistortEvent(e);
+        double dist;
+        if (map_->getNearest(e.p, dist, tuning_.matching_threshold, tuning_.matching_margin) >= 0) ++matched;
+        ++associated;
+    }
+    if (!idle_->checkMoving(rate, matched, associated)) {
+        stats_.add(TrackerStats::Idle, events.size());
+        // neither prediction nor covariance growth, the pose stays
+        history_.add(efk_.getState(), events.back().ts, true);
+        return false;
+    }
+    TRACK_INFO_STREAM("camera moving again at " << rate << " events/s, " << matched << " of " <<
+        associated << " sampled events matched");
+    // the idle time is not predicted, the first event restarts the filter time
+    last_event_ts = 0;
+    return true;
+}
+
+void TrackerCore::bufferEvents(const vector<Event>& events) {
+    if (start_buffer_.empty()) start_buffer_.resize(START_BUFFER_SIZE);
+    for (const Event& e : events) {
+        // the oldest event goes when full
+        if (start_size_ == start_buffer_.size()) {
+            start_head_ = (start_head_ + 1) % start_buffer_.size();
+            --start_size_;
+        }
+        start_buffer_[(start_head_ + start_size_) % start_buffer_.size()] = e;
+        ++start_size_;
+    }
+    // and the events older than start_buffer_duration_
+    if (events.empty()) return;
+    int64_t oldest = events.back().ts - start_buffer_duration_;
+    while (start_size_ > 0 and start_buffer_[start_head_].ts < oldest) {
+        start_head_ = (start_head_ + 1) % start_buffer_.size();
+        --start_size_;
+    }
+}
+
+void TrackerCore::replayBuffer(int64_t before) {
+    TRACK_TRACE_SCOPE_ARG("replay", start_size_);
+    replay_pending_ = false;
+    uint replayed = 0;
+    replay_batch_.reserve(EVENT_MAX_SIZE);
+    for (size_t i = 0; i < start_size_; ++i) {
+        const Event& e = start_buffer_[(start_head_ + i) % start_buffer_.size()];
+        if (e.ts < replay_from_ or e.ts >= before) continue;
+        replay_batch_.push_back(e);
+        // in batches, so that the tracking quality is checked as usual
+        if (replay_batch_.size() == EVENT_MAX_SIZE) {
+            replayed += replay_batch_.size();
+            processEvents(replay_batch_);
+            replay_batch_.clear();
+        }
+    }
+    if (!replay_batch_.empty()) {
+        replayed += replay_batch_.size();
+        processEvents(replay_batch_);
+    }
+    TRACK_INFO_STREAM("replayed " << replayed << " of " << start_size_ << " events buffered before the start");
+    // not needed anymore
+    vector<Event>().swap(start_buffer_);
+    vector<Event>().swap(replay_batch_);
+    start_head_ = start_size_ = 0;
+}
+
+bool TrackerCore::relocalize(int64_t ts) {
+    // a search takes a few ms, try at most every RELOCALIZATION_PERIOD seconds of events
+    if (!(relocalizer_ and waiting_fresh_pose_ and has_good_state_)) return false;
+    if (last_relocalization_ts_ != 0 and ts > last_relocalization_ts_ and
+        (ts - last_relocalization_ts_)*1e-9 < RELOCALIZATION_PERIOD) return false;
+    last_relocalization_ts_ = ts;
+
+    Vec3 r;
+    Quaternion q;
+    double score;
+    if (!relocalizer_->relocalize(*shared_map_->getSegments(), camera_matrix_,
+            last_good_state_.r, last_good_state_.q, r, q, score)) {
+        TRACK_DEBUG_STREAM("relocalization failed, best score " << score);
+        return false;
+    }
+    TRACK_INFO_STREAM("relocalized from events with score " << score);
+    reset(r, q);
+    return true;
+}
+
+void TrackerCore::updateMap() {
+    // build the projected map of a new version in the pool, it is swapped
+    // in at a later batch once ready
+    uint version = shared_map_->getVersion();
+    if (version != map_version_ and !map_building_) {
+        map_building_ = true;
+        map_version_ = version;
+        SharedMap::Segments segments = shared_map_->getSegments();
+        // project with the current estimate, the filter reprojects
+        // associated segments anyway so a slightly old pose is good enough
+        bool project = got_camera_info_ and (is_tracking_running_ or got_camera_pose_);
+        Vec3 r = camera_position_;
+        Quaternion q = camera_orientation_;
+        if (is_tracking_running_) {
+            EFK::State S = efk_.getState();
+            r = S.r;
+            q = S.q;
+        }
+        Vec4 K = camera_matrix_;
+        pool_->enqueue([this, segments, project, r, q, K] {
+            TRACK_TRACE_SCOPE_ARG("build map", segments->size());
+            std::shared_ptr<TrackerMap> map = std::make_shared<TrackerMap>(*segments);
+            if (project) map->projectAll(r, q, K);
+            std::atomic_store(&next_map_, map);
+            map_building_ = false;
+        });
+    }
+    swapMap();
+}
+
+void TrackerCore::swapMap() {
+    if (!std::atomic_load(&next_map_)) return;
+    // the old map is released here, once no batch uses it anymore
+    map_ = std::atomic_exchange(&next_map_, std::shared_ptr<TrackerMap>());
+    if (is_tracking_running_ and !map_->isProjected()) {
+        EFK::State S = efk_.getState();
+        map_->projectAll(S.r, S.q, camera_matrix_);
+    }
+    TRACK_INFO_STREAM("swapped to map version " << map_version_ << " with " << map_->size() << " segments");
+}
+
+void TrackerCore::handleEvent(const Event &e) {
+    if (last_event_ts == 0) { // first event
+        last_event_ts = e.ts;
+        return;
+    }
+    // predict
+    double dt = (e.ts - last_event_ts)*1e-9;
+    if (dt > 1e-2) TRACK_WARN_STREAM("huge dt " << dt);
+    else if (dt > 1e-4) TRACK_DEBUG_STREAM("big dt " << dt);
+
+    last_event_ts = e.ts;
+    {
+        TrackerStats::Timer timer(stats_, TrackerStats::Predict, time_event_);
+        efk_.predict(dt);
+    }
+    measurement_dt_ += dt;
+
+    // associate event to a segment in projected map
+    double dist;
+    int segmentId;
+    {
+        TrackerStats::Timer timer(stats_, TrackerStats::Association, time_event_);
+        segmentId = map_->getNearest(e.p, dist, tuning_.matching_threshold, tuning_.matching_margin);
+    }
+
+    monitor_.addEvent(segmentId >= 0);
+    stats_.add(segmentId >= 0 ? TrackerStats::Matched : TrackerStats::Rejected);
+
+    // no segment matched
+    if (segmentId < 0) {
+        // -2 is ambiguous, only events far from every segment are new edges
+        if (mapper_ and segmentId == -1) {
+            EFK::State S = efk_.getState();
+            mapper_->addObservation(e.p, e.ts*1e-9, S.r, S.q);
+        }
+        if (event_callback_) event_callback_(e, false);
+        return; // skip event
+    }
+
+    // update image of events and projected map
+    if (event_callback_) event_callback_(e, true);
+
+    if (hypotheses_) {
+        const SlamLine& sl = map_->getSegment(segmentId);
+        measurements_.push_back(MultiHypothesis::Measurement { e.p, measurement_dt_, sl.p1_3d, sl.p2_3d });
+        measurement_dt_ = 0;
+    }
+    if (smoother_) {
+        const SlamLine& sl = map_->getSegment(segmentId);
+        smoother_measurements_.push_back(FixedLagSmoother::Measurement { e.p, e.ts, sl.p1_3d, sl.p2_3d });
+    }
+
+    // reproject associated segment
+    {
+        TrackerStats::Timer timer(stats_, TrackerStats::Project, time_event_);
+        EFK::State S = efk_.getState();
+        map_->project(segmentId, S.r, S.q, camera_matrix_);
+    }
+
+    {
+        TrackerStats::Timer timer(stats_, TrackerStats::Update, time_event_);
+        // compute measurement (distance) and jacobian
+        Eigen::RowVector3d jac_d_r;
+        Eigen::RowVector4d jac_d_q;
+        dist = map_->getDistance(e.p, segmentId, jac_d_r, jac_d_q);
+        Eigen::Matrix<double, 1, 7> jac_d_pose;
+        jac_d_pose << jac_d_r, jac_d_q;
+
+        // update state in efk
+        monitor_.addInnovation(efk_.update(dist, jac_d_pose));
+    }
+    EFK::State S = efk_.getState();
+    history_.add(S, e.ts);
+    if (pose_callback_) pose_callback_(S, e.ts);
+}
+
+
+void TrackerCore::undistortEvent(Event &e) {
+    // using the first 3 terms of the exact inverse distortion model (only radial)
+    // https://www.ncbi.nlm.nih.gov/pmc/articles/PMC4934233/
+    // distortion is r *= 1 + k1*r^2 + k2*r^4 + k3*r^6
+    // undistortion is s *= 1 + (-k1)*s^2 + (3k1^2 - k2)*s^4 + (8k1k2 - 12k1^3 - k3)*s^6
+    double u0 = camera_matrix_[0];
+    double u1 = camera_matrix_[1];
+    double fx = camera_matrix_[2];
+    double fy = camera_matrix_[3];
+    e.p[0] = (e.p[0] - u0)/fx;
+    e.p[1] = (e.p[1] - u1)/fy;
+
+    double s2 = e.p.squaredNorm();
+    double s4 = s2*s2;
+    double s6 = s4*s2;
+    double undist_factor = 1 + undist_coeffs.dot(Vec3(s2,s4,s6));
+    e.p *= undist_factor;
+
+    e.p[0] = e.p[0]*fx + u0;
+    e.p[1] = e.p[1]*fy + u1;
+}
+
+} // namespace
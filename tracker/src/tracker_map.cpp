@@ -1,8 +1,10 @@
 #include "tracker/tracker_map.h"
+#include <fstream>
+#include <sstream>
 
 namespace track
 {
-TrackerMap::TrackerMap() {
+TrackerMap::TrackerMap() : is_projected_(false) {
     // setup known map, UGLY CODE, do this outside...
     const double hw = 85.0/2;
     vector<Point3d> model_points {
@@ -17,11 +19,48 @@ TrackerMap::TrackerMap() {
         map_.push_back(SlamLine(p1,p2));
     }
 }
+
+TrackerMap::TrackerMap(const vector<SlamLine>& segments) :
+    map_(segments), is_projected_(false) {}
+
+bool TrackerMap::loadSegments(const std::string& path, vector<SlamLine>& segments) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        TRACK_ERROR_STREAM("cannot open map file " << path);
+        return false;
+    }
+    segments.clear();
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        std::size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos or line[start] == '#') continue;
+        std::istringstream ss(line);
+        Point3d p1, p2;
+        if (!(ss >> p1[0] >> p1[1] >> p1[2] >> p2[0] >> p2[1] >> p2[2])) {
+            TRACK_ERROR_STREAM("bad segment in " << path << ':' << line_number);
+            return false;
+        }
+        segments.push_back(SlamLine(p1, p2));
+    }
+    return true;
+}
+
+vector<SlamLine> TrackerMap::copySegments() const {
+    vector<SlamLine> segments;
+    segments.reserve(map_.size());
+    for (const SlamLine& sl : map_)
+        segments.push_back(SlamLine(sl.p1_3d, sl.p2_3d));
+    return segments;
+}
+
 void TrackerMap::projectAll(const Vec3& camera_position,
                             const Quaternion& camera_orientation,
                             const Vec4& camera_matrix) {
     for (SlamLine& sl : map_)
         sl.project(camera_position, camera_orientation, camera_matrix);
+    is_projected_ = true;
 }
 
 void TrackerMap::project(int s_id,
@@ -97,7 +136,7 @@ cv::RotatedRect TrackerMap::getErrorEllipse(double chisq, const Point2d &mean, c
     // es.eigenvalues() is column vector sorted increasingly
     // es.eigenvectors() is matrix with eigenvectors as columns
     Eigen::SelfAdjointEigenSolver<Eigen::Matrix2d> es(cov);
-    ROS_DEBUG_STREAM("EIGEN VALUES ::: " << es.eigenvalues().transpose());
+    TRACK_DEBUG_STREAM("EIGEN VALUES ::: " << es.eigenvalues().transpose());
     // angle between the largest eigenvector and the x-axis
     double angle = atan2(es.eigenvectors().col(1)[1], es.eigenvectors().col(1)[0]);
     // angle between [0,2pi] instaed of [-pi, pi]
@@ -109,7 +148,7 @@ cv::RotatedRect TrackerMap::getErrorEllipse(double chisq, const Point2d &mean, c
     double half_minor_axis_size = chisq*sqrt(es.eigenvalues()[0]);
     if (!(std::isfinite(half_major_axis_size) and std::isfinite(half_minor_axis_size))) {
         half_major_axis_size = half_minor_axis_size = 0;
-        ROS_WARN("error ellipse is infinite");
+        TRACK_WARN_STREAM("error ellipse is infinite");
     }
     // return the oriented ellipse (-angle before opencv has cw angles...)
     return cv::RotatedRect(cv::Point2d(mean[0], mean[1]), cv::Size2f(half_major_axis_size, half_minor_axis_size), -angle);
@@ -0,0 +1,52 @@
+#include <ros/ros.h>
+#include <ros/callback_queue.h>
+#include <std_msgs/String.h>
+#include "tracker/tracker.h"
+
+// runs one tracker per camera, they share the map and the worker pool
+// each tracker has its own callback queue and spinner thread
+int main(int argc, char* argv[]) {
+  ros::init(argc, argv, "tracker_multi");
+
+  ros::NodeHandle nh;
+  ros::NodeHandle pnh("~");
+
+  std::vector<std::string> cameras;
+  if (!pnh.getParam("cameras", cameras) or cameras.empty()) {
+    ROS_FATAL("no cameras given in ~cameras");
+    return 1;
+  }
+
+  int threads;
+  pnh.param("threads", threads, 0);
+  std::shared_ptr<track::ThreadPool> pool = std::make_shared<track::ThreadPool>(threads);
+
+  std::shared_ptr<track::SharedMap> map = std::make_shared<track::SharedMap>();
+  std::string map_file;
+  if (pnh.getParam("map_file", map_file)) map->load(map_file);
+  ros::Subscriber load_map_sub = nh.subscribe<std_msgs::String>("load_map", 1,
+    [&map](const std_msgs::String::ConstPtr& msg) { map->loadAsync(msg->data); });
+
+  std::vector<std::unique_ptr<ros::CallbackQueue> > queues;
+  std::vector<std::unique_ptr<track::Tracker> > trackers;
+  std::vector<std::unique_ptr<ros::AsyncSpinner> > spinners;
+  for (const std::string& camera : cameras) {
+    // topics of each tracker live in the camera namespace, its params in
+    // the camera namespace of the node
+    ros::NodeHandle camera_nh(nh, camera);
+    ros::NodeHandle camera_pnh(pnh, camera);
+    queues.emplace_back(new ros::CallbackQueue());
+    camera_nh.setCallbackQueue(queues.back().get());
+    camera_pnh.setCallbackQueue(queues.back().get());
+    trackers.emplace_back(new track::Tracker(camera_nh, camera_pnh, map, pool));
+    spinners.emplace_back(new ros::AsyncSpinner(1, queues.back().get()));
+    spinners.back()->start();
+    ROS_INFO_STREAM("started tracker for " << camera);
+  }
+
+  ros::spin();
+
+  for (std::unique_ptr<ros::AsyncSpinner>& spinner : spinners) spinner->stop();
+  trackers.clear();
+  return 0;
+}
@@ -5,8 +5,9 @@ int main(int argc, char* argv[]) {
   ros::init(argc, argv, "tracker");
 
   ros::NodeHandle nh;
+  ros::NodeHandle pnh("~");
 
-  track::Tracker tracker(nh);
+  track::Tracker tracker(nh, pnh);
   ROS_INFO("started tracker");
   ros::spin();
 
@@ -5,7 +5,9 @@ namespace track
 {
 
 void TrackerNodelet::onInit() {
-    tracker = new track::Tracker(getNodeHandle());
+    // control callbacks may run in parallel, the tracker receives events
+    // on its own queue and thread
+    tracker.reset(new track::Tracker(getMTNodeHandle(), getMTPrivateNodeHandle()));
     NODELET_INFO_STREAM("Initialized " <<  getName() << " nodelet.");
 }
 
@@ -0,0 +1,238 @@
+#include <ros/ros.h>
+#include <rosbag/bag.h>
+#include <rosbag/view.h>
+#include <sensor_msgs/CameraInfo.h>
+#include <geometry_msgs/PoseStamped.h>
+#include <dvs_msgs/EventArray.h>
+#include <tracker/PackedEventArray.h>
+
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <map>
+#include <limits>
+
+#include "tracker/tracker_core.h"
+#include "tracker/event_conversions.h"
+#include "tracker/event_log.h"
+#include "tracker/trace.h"
+
+// Runs the tracker on a bag as fast as possible, without roscore:
+// messages are read with the rosbag API and fed straight into TrackerCore.
+// Tracking starts at the first camera pose, like a /reset right after it,
+// or with --auto_start 1 as the node with auto_start.
+//   tracker_offline <bag> [--option value ...]
+// options (defaults):
+//   --camera_info /dvs/camera_info   --camera_pose /track/init_pose
+//   --events /dvs/events (dvs_msgs/EventArray or tracker/PackedEventArray)
+//   --trajectory trajectory.txt      --map_file <85mm square>
+//   --threads 0  --hypotheses 0  --mapping 0  --auto_reset 1  --relocalization 1
+//   --auto_start 0
+//   --event_log <none>: read the events from an event log (see event_log.h)
+//                       instead of the bag, cut in packets of LOG_PACKET_DURATION
+//   --start 0: skip the first seconds of events and camera poses
+//   --trace <none>: Chrome trace of the packets, with TRACKER_TRACING (see trace.h)
+// The trajectory has one line "t x y z qx qy qz qw" (TUM format) per packet
+// tracked, with the time of its last event.
+
+using Clock = std::chrono::steady_clock;
+
+// ns of events in a packet read from an event log
+const uint64_t LOG_PACKET_DURATION = 1000000;
+
+int main(int argc, char* argv[]) {
+  if (argc < 2 or argc % 2 != 0) {
+    std::cerr << "usage: " << argv[0] << " <bag> [--option value ...]" << std::endl;
+    return 1;
+  }
+  std::map<std::string, std::string> options {
+    {"camera_info", "/dvs/camera_info"},
+    {"camera_pose", "/track/init_pose"},
+    {"events", "/dvs/events"},
+    {"trajectory", "trajectory.txt"},
+    {"map_file", ""},
+    {"threads", "0"},
+    {"hypotheses", "0"},
+    {"mapping", "0"},
+    {"auto_reset", "1"},
+    {"relocalization", "1"},
+    {"auto_start", "0"},
+    {"event_log", ""},
+    {"start", "0"},
+    {"trace", ""},
+  };
+  for (int i = 2; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (key.compare(0, 2, "--") != 0 or options.find(key.substr(2)) == options.end()) {
+      std::cerr << "unknown option " << key << std::endl;
+      return 1;
+    }
+    options[key.substr(2)] = argv[i + 1];
+  }
+  // the log format needs ros::Time, without a master it is the wall clock
+  ros::Time::init();
+  if (!options["trace"].empty()) {
+#ifndef TRACKER_TRACING
+    ROS_WARN_STREAM("built without TRACKER_TRACING, the trace will be empty");
+#endif
+    track::trace::enable();
+    track::trace::setThreadName("tracker_offline");
+  }
+
+  rosbag::Bag bag;
+  try {
+    bag.open(argv[1], rosbag::bagmode::Read);
+  } catch (const rosbag::BagException& e) {
+    ROS_FATAL_STREAM("cannot open " << argv[1] << ": " << e.what());
+    return 1;
+  }
+  std::ofstream trajectory(options["trajectory"]);
+  if (!trajectory) {
+    ROS_FATAL_STREAM("cannot write " << options["trajectory"]);
+    return 1;
+  }
+  trajectory << std::setprecision(9);
+
+  std::shared_ptr<track::ThreadPool> pool =
+      std::make_shared<track::ThreadPool>(std::stoi(options["threads"]));
+  std::shared_ptr<track::SharedMap> map = std::make_shared<track::SharedMap>();
+  if (!options["map_file"].empty() and !map->load(options["map_file"])) return 1;
+  track::TrackerCore::Params params;
+  params.hypotheses = std::stoi(options["hypotheses"]);
+  params.mapping = std::stoi(options["mapping"]) != 0;
+  params.auto_reset = std::stoi(options["auto_reset"]) != 0;
+  params.relocalization = std::stoi(options["relocalization"]) != 0;
+  params.auto_start = std::stoi(options["auto_start"]) != 0;
+  track::TrackerCore core(params, map, pool);
+
+  // events of the bag are ignored with an event log
+  track::EventLogReader log;
+  bool use_log = !options["event_log"].empty();
+  if (use_log and !log.open(options["event_log"])) {
+    ROS_FATAL_STREAM("cannot read event log " << options["event_log"]);
+    return 1;
+  }
+  std::vector<std::string> topics { options["camera_info"], options["camera_pose"] };
+  if (!use_log) topics.push_back(options["events"]);
+  rosbag::View view(bag, rosbag::TopicQuery(topics));
+
+  // event and message times are both ROS time of the camera driver
+  ros::Time start;
+  start.fromNSec(use_log ? log.beginTime() : view.getBeginTime().toNSec());
+  start = start + ros::Duration(std::stod(options["start"]));
+  track::PackedEvent next_event;
+  bool has_next_event = false;
+  if (use_log) {
+    log.seek(start.toNSec());
+    has_next_event = log.next(next_event);
+  }
+
+  bool calibrated = false, started = false;
+  vector<track::TrackerCore::Event> batch;
+  vector<track::PackedEvent> packet;
+  // processing time of each packet (decoding and tracking), in seconds
+  vector<double> latencies;
+  // events received and kept by the subsampling
+  uint64_t events = 0, tracked = 0, poses = 0;
+  // track batch, decoded since t0
+  auto trackBatch = [&](const Clock::time_point& t0) {
+    if (batch.empty()) return;
+    tracked += batch.size();
+    core.processEvents(batch);
+    latencies.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+    if (core.isTracking()) {
+      track::EFK::State S = core.getState();
+      int64_t ts = batch.back().ts;
+      trajectory << ts / 1000000000 << '.' << std::setw(9) << std::setfill('0') << ts % 1000000000 <<
+          std::setfill(' ') << ' ' << S.r[0] << ' ' << S.r[1] << ' ' << S.r[2] << ' ' <<
+          S.q.x() << ' ' << S.q.y() << ' ' << S.q.z() << ' ' << S.q.w() << '\n';
+      ++poses;
+    }
+  };
+  // track the events of the log until a time (ns)
+  auto trackLog = [&](uint64_t until) {
+    while (has_next_event and next_event.t < until) {
+      Clock::time_point t0 = Clock::now();
+      uint64_t end = next_event.t + LOG_PACKET_DURATION;
+      packet.clear();
+      while (has_next_event and next_event.t < end) {
+        packet.push_back(next_event);
+        has_next_event = log.next(next_event);
+      }
+      events += packet.size();
+      batch.clear();
+      track::toBatch(packet, batch);
+      trackBatch(t0);
+    }
+  };
+
+  Clock::time_point begin = Clock::now();
+  for (const rosbag::MessageInstance& m : view) {
+    if (m.getTopic() == options["camera_info"]) {
+      sensor_msgs::CameraInfo::ConstPtr msg = m.instantiate<sensor_msgs::CameraInfo>();
+      if (!msg or calibrated) continue;
+      Vec4 K;
+      K << msg->K[2], msg->K[5], msg->K[0], msg->K[4];
+      core.setCalibration(K, msg->D);
+      calibrated = true;
+      continue;
+    }
+    if (m.getTime() < start) continue;
+    if (use_log) trackLog(m.getTime().toNSec());
+    if (m.getTopic() == options["camera_pose"]) {
+      geometry_msgs::PoseStamped::ConstPtr msg = m.instantiate<geometry_msgs::PoseStamped>();
+      if (!msg) continue;
+      core.setCameraPose(Vec3(msg->pose.position.x, msg->pose.position.y, msg->pose.position.z),
+                         Quaternion(msg->pose.orientation.w, msg->pose.orientation.x,
+                                    msg->pose.orientation.y, msg->pose.orientation.z),
+                         msg->header.stamp.toNSec());
+      if (calibrated and !started and !params.auto_start) {
+        core.start();
+        started = true;
+      }
+    } else {
+      Clock::time_point t0 = Clock::now();
+      batch.clear();
+      if (dvs_msgs::EventArray::ConstPtr msg = m.instantiate<dvs_msgs::EventArray>()) {
+        events += msg->events.size();
+        track::toBatch(*msg, batch);
+      } else if (tracker::PackedEventArray::ConstPtr msg = m.instantiate<tracker::PackedEventArray>()) {
+        events += msg->count;
+        track::toBatch(*msg, batch);
+      }
+      trackBatch(t0);
+    }
+  }
+  if (use_log) trackLog(std::numeric_limits<uint64_t>::max());
+  double total = std::chrono::duration<double>(Clock::now() - begin).count();
+  bag.close();
+
+  if (latencies.empty()) {
+    ROS_ERROR_STREAM("no events in " << options["events"]);
+    return 1;
+  }
+  double processing = 0;
+  for (double l : latencies) processing += l;
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies] (double p) {
+    return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] * 1e3;
+  };
+  std::cout << std::fixed << std::setprecision(3) <<
+      events << " events in " << latencies.size() << " packets, " << poses << " poses written to " <<
+      options["trajectory"] << '\n' <<
+      "events/s: " << events / processing << " processing, " << events / total << " overall (" <<
+      total << " s)\n" <<
+      "packet latency (ms): p50 " << percentile(0.5) << ", p90 " << percentile(0.9) <<
+      ", p99 " << percentile(0.99) << ", max " << latencies.back() * 1e3 << '\n';
+  core.getStats().add(track::TrackerStats::Received, events);
+  core.getStats().add(track::TrackerStats::Subsampled, events - tracked);
+  core.getStats().report(std::cout);
+  if (!options["trace"].empty() and !track::trace::write(options["trace"])) {
+    ROS_ERROR_STREAM("cannot write trace to " << options["trace"]);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+#include <chrono>
+#include <algorithm>
+#include <string>
+#include <map>
+
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "tracker/trace.h"
+
+// Tracks simulated events (see EventSimulator) as fast as possible, without
+// ROS, for load and regression tests: the core starts from the true pose and
+// the estimate is compared to the ground truth after each packet.
+//   tracker_sim [--option value ...]
+// options (defaults):
+//   --duration 10 (s of simulated events)  --rate 1e6 (events/s)
+//   --noise_ratio 0.05  --packet_duration 1 (ms)  --seed 1
+//   --map_file <85mm square>  --threads 0  --hypotheses 0
+//   --smoothing 0 (1 runs the fixed-lag smoother)  --event_max_size 2000 (events per packet)
+//   --trajectory <none>: "t x y z qx qy qz qw" of the estimate per packet
+//   --trace <none>: Chrome trace of the packets, with TRACKER_TRACING (see trace.h)
+// Exits with 1 if tracking is lost.
+
+using Clock = std::chrono::steady_clock;
+
+int main(int argc, char* argv[]) {
+  if (argc % 2 != 1) {
+    std::cerr << "usage: " << argv[0] << " [--option value ...]" << std::endl;
+    return 1;
+  }
+  std::map<std::string, std::string> options {
+    {"duration", "10"},
+    {"rate", "1e6"},
+    {"noise_ratio", "0.05"},
+    {"packet_duration", "1"},
+    {"seed", "1"},
+    {"map_file", ""},
+    {"threads", "0"},
+    {"hypotheses", "0"},
+    {"smoothing", "0"},
+    {"event_max_size", "2000"},
+    {"trajectory", ""},
+    {"trace", ""},
+  };
+  for (int i = 1; i < argc; i += 2) {
+    std::string key = argv[i];
+    if (key.compare(0, 2, "--") != 0 or options.find(key.substr(2)) == options.end()) {
+      std::cerr << "unknown option " << key << std::endl;
+      return 1;
+    }
+    options[key.substr(2)] = argv[i + 1];
+  }
+  if (!options["trace"].empty()) {
+#ifndef TRACKER_TRACING
+    std::cerr << "built without TRACKER_TRACING, the trace will be empty" << std::endl;
+#endif
+    // before the pool, so that its threads are named
+    track::trace::enable();
+    track::trace::setThreadName("tracker_sim");
+  }
+
+  std::shared_ptr<track::ThreadPool> pool =
+      std::make_shared<track::ThreadPool>(std::stoi(options["threads"]));
+  std::shared_ptr<track::SharedMap> map = std::make_shared<track::SharedMap>();
+  if (!options["map_file"].empty() and !map->load(options["map_file"])) return 1;
+  track::TrackerCore::Params params;
+  params.hypotheses = std::stoi(options["hypotheses"]);
+  params.smoothing = std::stoi(options["smoothing"]) != 0;
+  // a lost track is a failure here
+  params.auto_reset = false;
+  params.relocalization = false;
+  track::TrackerCore core(params, map, pool);
+  track::TrackerCore::Tuning tuning = core.getTuning();
+  tuning.event_max_size = std::stoul(options["event_max_size"]);
+  core.setTuning(tuning);
+
+  track::EventSimulator::Params sim_params;
+  sim_params.rate = std::stod(options["rate"]);
+  sim_params.noise_ratio = std::stod(options["noise_ratio"]);
+  sim_params.seed = std::stoul(options["seed"]);
+  sim_params.start_time = 1000000000; // away from 0, the "no event yet" time of the core
+  track::EventSimulator simulator(sim_params, *map->getSegments());
+
+  std::ofstream trajectory;
+  if (!options["trajectory"].empty()) {
+    trajectory.open(options["trajectory"]);
+    trajectory << std::setprecision(9);
+  }
+
+  core.setCalibration(sim_params.K, vector<double>(5, 0.0));
+  Vec3 r;
+  Quaternion q;
+  simulator.getPose(sim_params.start_time, r, q);
+  core.setCameraPose(r, q, sim_params.start_time);
+  core.start();
+
+  const uint64_t packet = uint64_t(std::stod(options["packet_duration"])*1e6);
+  const uint64_t end = sim_params.start_time + uint64_t(std::stod(options["duration"])*1e9);
+  vector<track::PackedEvent> events;
+  vector<track::TrackerCore::Event> batch;
+  // processing time of each packet, in seconds
+  vector<double> latencies;
+  uint64_t total_events = 0, tracked = 0;
+  double position_error2 = 0, angle_error2 = 0, max_position_error = 0;
+  uint64_t t = sim_params.start_time;
+  for (; t < end and core.isTracking(); t += packet) {
+    events.clear();
+    simulator.generate(t, t + packet, events);
+    if (events.empty()) continue;
+    total_events += events.size();
+
+    Clock::time_point t0 = Clock::now();
+    batch.clear();
+    uint increment = track::TrackerCore::increment(events.size(), tuning.event_max_size);
+    for (size_t i = 0; i < events.size(); i += increment)
+      batch.push_back(track::TrackerCore::Event { Point2d(events[i].x, events[i].y), int64_t(events[i].t) });
+    tracked += batch.size();
+    core.processEvents(batch);
+    latencies.push_back(std::chrono::duration<double>(Clock::now() - t0).count());
+
+    track::EFK::State S = core.getState();
+    simulator.getPose(batch.back().ts, r, q);
+    double position_error = (S.r - r).norm();
+    double angle_error = S.q.angularDistance(q);
+    position_error2 += position_error*position_error;
+    angle_error2 += angle_error*angle_error;
+    max_position_error = std::max(max_position_error, position_error);
+    if (trajectory.is_open()) {
+      int64_t ts = batch.back().ts;
+      trajectory << ts / 1000000000 << '.' << std::setw(9) << std::setfill('0') << ts % 1000000000 <<
+          std::setfill(' ') << ' ' << S.r[0] << ' ' << S.r[1] << ' ' << S.r[2] << ' ' <<
+          S.q.x() << ' ' << S.q.y() << ' ' << S.q.z() << ' ' << S.q.w() << '\n';
+    }
+  }
+
+  if (latencies.empty()) {
+    std::cerr << "no events simulated" << std::endl;
+    return 1;
+  }
+  double processing = 0;
+  for (double l : latencies) processing += l;
+  size_t packets = latencies.size();
+  std::sort(latencies.begin(), latencies.end());
+  auto percentile = [&latencies] (double p) {
+    return latencies[std::min(latencies.size() - 1, size_t(p * latencies.size()))] * 1e3;
+  };
+  bool lost = !core.isTracking();
+  std::cout << std::fixed << std::setprecision(3) <<
+      total_events << " events in " << packets << " packets, " <<
+      (t - sim_params.start_time)*1e-9 << " s tracked" << (lost ? " (LOST)" : "") << '\n' <<
+      "events/s: " << total_events / processing << " processing (" << sim_params.rate << " simulated)\n" <<
+      "packet latency (ms): p50 " << percentile(0.5) << ", p90 " << percentile(0.9) <<
+      ", p99 " << percentile(0.99) << ", max " << latencies.back() * 1e3 << '\n' <<
+      "error: position rms " << std::sqrt(position_error2 / packets) << " mm (max " <<
+      max_position_error << "), orientation rms " << std::sqrt(angle_error2 / packets) * 180 / M_PI <<
+      " deg\n";
+  core.getStats().add(track::TrackerStats::Received, total_events);
+  core.getStats().add(track::TrackerStats::Subsampled, total_events - tracked);
+  core.getStats().report(std::cout);
+  if (!options["trace"].empty() and !track::trace::write(options["trace"])) {
+    std::cerr << "cannot write trace to " << options["trace"] << std::endl;
+    return 1;
+  }
+  return lost ? 1 : 0;
+}
@@ -0,0 +1,95 @@
+#include "tracker/tracker_stats.h"
+#include <algorithm>
+#include <iomanip>
+#include <limits>
+
+namespace track
+{
+
+LatencyHistogram::LatencyHistogram() {
+    clear();
+}
+
+void LatencyHistogram::merge(const LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+void LatencyHistogram::clear() {
+    std::fill(counts_, counts_ + BUCKETS, 0);
+    count_ = sum_ = max_ = 0;
+    min_ = std::numeric_limits<uint64_t>::max();
+}
+
+uint64_t LatencyHistogram::upperBound(int index) {
+    if (index < SUB_BUCKETS) return index;
+    int bits = index/SUB_BUCKETS + SUB_BITS - 1;
+    uint64_t sub = index % SUB_BUCKETS;
+    // last value of the bucket
+    return ((SUB_BUCKETS + sub + 1) << (bits - SUB_BITS)) - 1;
+}
+
+uint64_t LatencyHistogram::percentile(double p) const {
+    if (count_ == 0) return 0;
+    // rank of the quantile, 1 based
+    uint64_t rank = std::max<uint64_t>(1, uint64_t(std::min(1.0, std::max(0.0, p))*count_ + 0.5));
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += counts_[i];
+        if (seen >= rank) return std::min(max_, std::max(min_, upperBound(i)));
+    }
+    return max_;
+}
+
+TrackerStats::TrackerStats(unsigned sampling) :
+    sampling_(sampling), sample_counter_(0) {
+    std::fill(counters_, counters_ + COUNTERS, 0);
+}
+
+const char* TrackerStats::stageName(Stage stage) {
+    static const char* names[STAGES] = {
+        "conversion", "undistortion", "predict", "association", "project",
+        "update", "publish", "visualization", "packet", "end_to_end" };
+    return names[stage];
+}
+
+const char* TrackerStats::counterName(Counter counter) {
+    static const char* names[COUNTERS] = {
+        "received", "subsampled", "dropped", "matched", "rejected", "idle" };
+    return names[counter];
+}
+
+void TrackerStats::merge(const TrackerStats& other) {
+    for (int i = 0; i < STAGES; ++i) stages_[i].merge(other.stages_[i]);
+    for (int i = 0; i < COUNTERS; ++i) counters_[i] += other.counters_[i];
+}
+
+void TrackerStats::clear() {
+    for (LatencyHistogram& h : stages_) h.clear();
+    std::fill(counters_, counters_ + COUNTERS, 0);
+}
+
+void TrackerStats::report(std::ostream& out) const {
+    out << "events:";
+    for (int i = 0; i < COUNTERS; ++i)
+        out << ' ' << counterName(Counter(i)) << ' ' << counters_[i];
+    out << '\n' << std::left << std::setw(14) << "stage (us)" << std::right <<
+        std::setw(10) << "count" << std::setw(10) << "mean" << std::setw(10) << "p50" <<
+        std::setw(10) << "p90" << std::setw(10) << "p99" << std::setw(10) << "max" << '\n';
+    std::ios::fmtflags flags = out.flags();
+    out << std::fixed << std::setprecision(3);
+    for (int i = 0; i < STAGES; ++i) {
+        const LatencyHistogram& h = stages_[i];
+        if (h.count() == 0) continue;
+        out << std::left << std::setw(14) << stageName(Stage(i)) << std::right <<
+            std::setw(10) << h.count() << std::setw(10) << h.mean()*1e-3 <<
+            std::setw(10) << h.percentile(0.5)*1e-3 << std::setw(10) << h.percentile(0.9)*1e-3 <<
+            std::setw(10) << h.percentile(0.99)*1e-3 << std::setw(10) << h.max()*1e-3 << '\n';
+    }
+    out.flags(flags);
+}
+
+}
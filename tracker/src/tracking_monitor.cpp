@@ -0,0 +1,40 @@
+#include "tracker/tracking_monitor.h"
+
+namespace track
+{
+
+TrackingMonitor::TrackingMonitor() : TrackingMonitor(Params()) {}
+
+TrackingMonitor::TrackingMonitor(const Params& params) : params_(params) {
+    reset();
+}
+
+void TrackingMonitor::reset() {
+    health_ = Health { 1, 0, 0, 0 };
+    events_ = matched_ = updates_ = 0;
+    nis_sum_ = 0;
+    bad_windows_ = 0;
+}
+
+bool TrackingMonitor::check(const EFK::State& X, const Mat13& P) {
+    // covariance order is [r q v w]
+    health_.position_trace = P.block<3,3>(0,0).trace();
+    health_.orientation_trace = P.block<4,4>(3,3).trace();
+    if (!(X.r.allFinite() and X.q.coeffs().allFinite() and std::isfinite(health_.position_trace)))
+        return true;
+    if (health_.position_trace > params_.max_position_trace or
+        health_.orientation_trace > params_.max_orientation_trace)
+        return true;
+
+    if (events_ < params_.window_events) return false;
+    health_.association_ratio = double(matched_) / events_;
+    health_.mean_nis = updates_ > 0 ? nis_sum_ / updates_ : 0;
+    bool bad = health_.association_ratio < params_.min_association_ratio or
+               health_.mean_nis > params_.max_mean_nis;
+    bad_windows_ = bad ? bad_windows_ + 1 : 0;
+    events_ = matched_ = updates_ = 0;
+    nis_sum_ = 0;
+    return bad_windows_ >= params_.max_bad_windows;
+}
+
+} // namespace
@@ -0,0 +1,187 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include "tracker/tracker_core.h"
+
+using namespace track;
+using namespace std;
+
+// Kernels of the tracker on representative states: a DAVIS240 calibration,
+// a camera 30cm in front of the map moving at tracking speeds. Random inputs
+// come from fixed seeds so that runs are comparable.
+
+namespace
+{
+
+const Vec4 K(120, 90, 200, 200); // [u0 u1 fx fy]
+const vector<double> D {-0.35, 0.15, 0, 0, 0};
+const int WIDTH = 240;
+const int HEIGHT = 180;
+// events cycled through by the benchmarks
+const int POINTS = 1024;
+
+EFK::State cameraState() {
+    EFK::State X;
+    X.r = Vec3(10, -5, -300);
+    X.q = Quaternion(AngleAxis(0.1, Vec3(1, 2, 3).normalized()));
+    X.v = Vec3(50, 20, -10);
+    X.w = AngleAxis(0.5, Vec3(-1, 1, 2).normalized());
+    return X;
+}
+
+// covariance after some tracking, correlated by the updates
+Mat13 cameraCovariance() {
+    mt19937 rng(7);
+    normal_distribution<double> n(0, 1);
+    Eigen::Matrix<double, 13, 13> A;
+    for (int i = 0; i < A.size(); ++i) A(i) = n(rng);
+    return 1e-3*A*A.transpose() + 1e-2*Mat13::Identity();
+}
+
+vector<Point2d> randomPoints(unsigned seed) {
+    mt19937 rng(seed);
+    uniform_real_distribution<double> x(0, WIDTH), y(0, HEIGHT);
+    vector<Point2d> points;
+    for (int i = 0; i < POINTS; ++i) points.push_back(Point2d(x(rng), y(rng)));
+    return points;
+}
+
+// segments of 10 to 100mm in the field of view
+vector<SlamLine> randomSegments(int n, unsigned seed) {
+    mt19937 rng(seed);
+    uniform_real_distribution<double> position(-100, 100), length(10, 100), angle(0, 2*M_PI);
+    vector<SlamLine> segments;
+    for (int i = 0; i < n; ++i) {
+        Point3d p1(position(rng), position(rng), 0);
+        double l = length(rng), a = angle(rng);
+        segments.push_back(SlamLine(p1, p1 + l*Point3d(cos(a), sin(a), 0)));
+    }
+    return segments;
+}
+
+SlamLine projectedSegment() {
+    EFK::State X = cameraState();
+    SlamLine s(Point3d(-42.5, -42.5, 0), Point3d(42.5, -42.5, 0));
+    s.project(X.r, X.q, K);
+    return s;
+}
+
+}
+
+static void BM_EFKPredict(benchmark::State& state) {
+    EFK efk(Vec3(2, 2, 2), Vec3(4, 4, 4), 1);
+    efk.init(cameraState(), cameraCovariance());
+    for (auto _ : state) {
+        // about 1 Mev/s
+        efk.predict(1e-6);
+        benchmark::DoNotOptimize(efk.P_);
+    }
+}
+BENCHMARK(BM_EFKPredict);
+
+static void BM_EFKUpdate(benchmark::State& state) {
+    EFK efk(Vec3(2, 2, 2), Vec3(4, 4, 4), 1);
+    EFK::State X = cameraState();
+    efk.init(X, cameraCovariance());
+    // measurements of events around the segments of the square
+    TrackerMap map;
+    map.projectAll(X.r, X.q, K);
+    vector<Point2d> points = randomPoints(1);
+    vector<double> distances;
+    vector<Eigen::Matrix<double, 1, 7> > jacobians;
+    for (int i = 0; i < POINTS; ++i) {
+        Eigen::RowVector3d jac_d_r;
+        Eigen::RowVector4d jac_d_q;
+        distances.push_back(map.getDistance(points[i], i % map.size(), jac_d_r, jac_d_q));
+        Eigen::Matrix<double, 1, 7> H;
+        H << jac_d_r, jac_d_q;
+        jacobians.push_back(H);
+    }
+    int i = 0;
+    for (auto _ : state) {
+        // small residuals, the filter stays around the same state
+        benchmark::DoNotOptimize(efk.update(1e-3*distances[i], jacobians[i]));
+        i = (i + 1) % POINTS;
+    }
+}
+BENCHMARK(BM_EFKUpdate);
+
+static void BM_SlamLineProject(benchmark::State& state) {
+    EFK::State X = cameraState();
+    SlamLine s(Point3d(-42.5, -42.5, 0), Point3d(42.5, -42.5, 0));
+    for (auto _ : state) {
+        s.project(X.r, X.q, K);
+        benchmark::DoNotOptimize(s.jac_points_2d_rq);
+    }
+}
+BENCHMARK(BM_SlamLineProject);
+
+static void BM_SlamLineDistance(benchmark::State& state) {
+    SlamLine s = projectedSegment();
+    vector<Point2d> points = randomPoints(2);
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(SlamLine::getDistance(s, points[i]));
+        i = (i + 1) % POINTS;
+    }
+}
+BENCHMARK(BM_SlamLineDistance);
+
+static void BM_SlamLineDistanceJacobians(benchmark::State& state) {
+    SlamLine s = projectedSegment();
+    vector<Point2d> points = randomPoints(3);
+    Eigen::RowVector3d jac_d_r;
+    Eigen::RowVector4d jac_d_q;
+    int i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(SlamLine::getDistance(s, points[i], jac_d_r, jac_d_q));
+        benchmark::DoNotOptimize(jac_d_q);
+        i = (i + 1) % POINTS;
+    }
+}
+BENCHMARK(BM_SlamLineDistanceJacobians);
+
+// map size as argument
+static void BM_TrackerMapGetNearest(benchmark::State& state) {
+    EFK::State X = cameraState();
+    TrackerMap map(randomSegments(state.range(0), 4));
+    map.projectAll(X.r, X.q, K);
+    vector<Point2d> points = randomPoints(5);
+    int i = 0;
+    for (auto _ : state) {
+        double distance;
+        // thresholds of TrackerCore
+        benchmark::DoNotOptimize(map.getNearest(points[i], distance, 2.5, 10));
+        i = (i + 1) % POINTS;
+    }
+    state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_TrackerMapGetNearest)->RangeMultiplier(4)->Range(4, 4096)->Complexity();
+
+static void BM_UndistortEvent(benchmark::State& state) {
+    TrackerCore core(TrackerCore::Params(), make_shared<SharedMap>(), make_shared<ThreadPool>(1));
+    core.setCalibration(K, D);
+    vector<Point2d> points = randomPoints(6);
+    int i = 0;
+    for (auto _ : state) {
+        TrackerCore::Event e { points[i], 0 };
+        core.undistortEvent(e);
+        benchmark::DoNotOptimize(e.p);
+        i = (i + 1) % POINTS;
+    }
+}
+BENCHMARK(BM_UndistortEvent);
+
+static void BM_Draw2dMapWithCov(benchmark::State& state) {
+    EFK::State X = cameraState();
+    TrackerMap map;
+    map.projectAll(X.r, X.q, K);
+    Eigen::Matrix<double, 7, 7> P = cameraCovariance().block<7,7>(0,0);
+    cv::Mat img(HEIGHT, WIDTH, CV_8UC3, cv::Scalar(0,0,0));
+    for (auto _ : state) {
+        map.draw2dMapWithCov(img, P);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_Draw2dMapWithCov);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <cstdint>
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+
+// Tracking of simulated events shared by the tests, in packets of 1 ms
+
+namespace track
+{
+
+const uint64_t SIM_PACKET_DURATION = 1000000; // ns
+
+// events of the simulator in [t0, t1) appended to batch, keeping one every
+// TrackerCore::increment as the node does, or all of them
+inline void simulateBatch(EventSimulator& simulator, uint64_t t0, uint64_t t1,
+                          vector<TrackerCore::Event>& batch, bool subsample = true) {
+    vector<PackedEvent> packed;
+    simulator.generate(t0, t1, packed);
+    uint increment = subsample ? TrackerCore::increment(packed.size()) : 1;
+    for (size_t i = 0; i < packed.size(); i += increment)
+        batch.push_back(TrackerCore::Event { Point2d(packed[i].x, packed[i].y), int64_t(packed[i].t) });
+}
+
+// track packets of the simulator from t, t is moved after them
+inline void trackPackets(TrackerCore& core, EventSimulator& simulator, uint64_t& t, int packets) {
+    vector<TrackerCore::Event> batch;
+    for (int i = 0; i < packets; ++i, t += SIM_PACKET_DURATION) {
+        batch.clear();
+        simulateBatch(simulator, t, t + SIM_PACKET_DURATION, batch);
+        core.processEvents(batch);
+    }
+}
+
+// calibrate the core and start tracking from the simulated pose at t
+inline void startTracking(TrackerCore& core, const EventSimulator& simulator, const Vec4& K, uint64_t t) {
+    core.setCalibration(K, vector<double>(5, 0.0));
+    Vec3 r;
+    Quaternion q;
+    simulator.getPose(t, r, q);
+    core.setCameraPose(r, q, t);
+    core.start();
+}
+
+// mm between the tracked position and the simulated one at t
+inline double positionError(TrackerCore& core, const EventSimulator& simulator, uint64_t t) {
+    Vec3 r;
+    Quaternion q;
+    simulator.getPose(t, r, q);
+    return (core.getState().r - r).norm();
+}
+
+} // namespace
@@ -19,7 +19,7 @@ TEST(Slamline, CameraFrameIsWorldFrame){
     Point3d p2(4,0,2);
     SlamLine sl = SlamLine(p1, p2);
     // world frame = camera frame
-    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(1,1,0,0));
+    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(0,0,1,1));
     EXPECT_EQ(Point2d(1,0), sl.p1_2d);
     EXPECT_EQ(Point2d(2,0), sl.p2_2d);
 }
@@ -29,7 +29,7 @@ TEST(Slamline, CameraFrameIsAlignedWithWorldFrame){
     Point3d p2(3,0,1);
     SlamLine sl = SlamLine(p1, p2);
     // world frame = camera frame
-    sl.project(Vec3(1,0,0), Quaternion(1,0,0,0), Vec4(1,1,0,0));
+    sl.project(Vec3(1,0,0), Quaternion(1,0,0,0), Vec4(0,0,1,1));
     EXPECT_EQ(Point2d(0,0), sl.p1_2d);
     EXPECT_EQ(Point2d(2,0), sl.p2_2d);
 }
@@ -39,7 +39,7 @@ TEST(Slamline, CameraFrameIsAtWorldFrame){
     Point3d p2(3,1,1);
     SlamLine sl = SlamLine(p1, p2);
     // camera frame at 0,0,0 rotated 90deg around X axis
-    sl.project(Vec3(0,0,0), Quaternion(cos(M_PI/4),sin(M_PI/4),0,0), Vec4(1,1,0,0));
+    sl.project(Vec3(0,0,0), Quaternion(cos(M_PI/4),sin(M_PI/4),0,0), Vec4(0,0,1,1));
     EXPECT_DOUBLE_EQ(-1, sl.p1_2d[0]);
     EXPECT_DOUBLE_EQ(-1, sl.p1_2d[1]);
     EXPECT_DOUBLE_EQ(-3, sl.p2_2d[0]);
@@ -51,7 +51,7 @@ TEST(SlamLine, Line1) {
     Point3d p2(4,0,2); // 2,0
     SlamLine sl = SlamLine(p1, p2);
     // world frame = camera frame
-    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(1,1,0,0));
+    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(0,0,1,1));
     EXPECT_DOUBLE_EQ(0, sl.line_2d[0]);
     EXPECT_DOUBLE_EQ(1, sl.line_2d[1]);
     EXPECT_DOUBLE_EQ(0, sl.line_2d[2]);
@@ -62,7 +62,7 @@ TEST(SlamLine, Distance) {
     Point3d p2(4,0,2); // 2,0
     SlamLine sl = SlamLine(p1, p2);
     // world frame = camera frame
-    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(1,1,0,0));
+    sl.project(Vec3(0,0,0), Quaternion(1,0,0,0), Vec4(0,0,1,1));
     EXPECT_DOUBLE_EQ(0, SlamLine::getDistance(sl, Point2d(1,0)));
     EXPECT_DOUBLE_EQ(0, SlamLine::getDistance(sl, Point2d(5,0)));
     EXPECT_DOUBLE_EQ(1, SlamLine::getDistance(sl, Point2d(5,1)));
@@ -0,0 +1,82 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "sim_util.h"
+
+using namespace track;
+using namespace std;
+
+// Every heap allocation of the process goes through this hook, counted
+// while counting is set.
+namespace
+{
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocations(0);
+
+// Every form of new and delete calls this pair, not inlined: gcc would
+// otherwise see the free of an inlined delete on a pointer of new
+// (-Wmismatched-new-delete).
+__attribute__((noinline)) void* allocate(size_t size) {
+    if (counting) ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+__attribute__((noinline)) void deallocate(void* p) noexcept { std::free(p); }
+}
+
+void* operator new(size_t size) { return allocate(size); }
+void* operator new[](size_t size) { return allocate(size); }
+void operator delete(void* p) noexcept { deallocate(p); }
+void operator delete[](void* p) noexcept { deallocate(p); }
+void operator delete(void* p, size_t) noexcept { deallocate(p); }
+void operator delete[](void* p, size_t) noexcept { deallocate(p); }
+
+// Allocations while tracking the packets of a recorded stream after a
+// warm-up, tracked events in events
+static uint64_t trackingAllocations(const TrackerCore::Params& params, uint64_t& events) {
+    EventSimulator::Params sim_params;
+    sim_params.start_time = 1000000000;
+    std::shared_ptr<SharedMap> map = std::make_shared<SharedMap>();
+    EventSimulator simulator(sim_params, *map->getSegments());
+    // 1s of packets
+    const int PACKETS = 1000, WARM_UP = 100;
+    vector<vector<TrackerCore::Event> > packets(PACKETS);
+    for (int i = 0; i < PACKETS; ++i) {
+        uint64_t t = sim_params.start_time + i*SIM_PACKET_DURATION;
+        simulateBatch(simulator, t, t + SIM_PACKET_DURATION, packets[i], false);
+    }
+
+    TrackerCore core(params, map, std::make_shared<ThreadPool>(2));
+    startTracking(core, simulator, sim_params.K, sim_params.start_time);
+    events = 0;
+    allocations = 0;
+    for (int i = 0; i < PACKETS; ++i) {
+        if (i == WARM_UP) counting = true;
+        core.processEvents(packets[i]);
+        if (i >= WARM_UP) events += packets[i].size();
+    }
+    counting = false;
+    EXPECT_TRUE(core.isTracking());
+    return allocations;
+}
+
+// The steady state event path of the core must not allocate
+TEST(TrackerCore, NoAllocationPerEvent) {
+    TrackerCore::Params params;
+    params.auto_reset = false;
+    uint64_t events;
+    EXPECT_EQ(0u, trackingAllocations(params, events)) << "over " << events << " events";
+    EXPECT_GT(events, 0u);
+}
+
+// nor with the hypotheses running in the pool
+TEST(TrackerCore, NoAllocationPerEventWithHypotheses) {
+    TrackerCore::Params params;
+    params.auto_reset = false;
+    params.hypotheses = 3;
+    uint64_t events;
+    EXPECT_EQ(0u, trackingAllocations(params, events)) << "over " << events << " events";
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "sim_util.h"
+
+using namespace track;
+using namespace std;
+
+class AutoStart : public testing::Test {
+protected:
+    AutoStart() : map(std::make_shared<SharedMap>()), pool(std::make_shared<ThreadPool>(2)),
+        simulator(simParams(), *map->getSegments()), t(simParams().start_time) {
+        params.auto_start = true;
+    }
+    static EventSimulator::Params simParams() {
+        EventSimulator::Params sim_params;
+        sim_params.start_time = 1000000000;
+        return sim_params;
+    }
+    // pose of track_init for the image at ts, offset in mm
+    void sendPose(TrackerCore& core, uint64_t ts, double offset = 0) {
+        Vec3 r;
+        Quaternion q;
+        simulator.getPose(ts, r, q);
+        core.setCameraPose(r + Vec3(offset, 0, 0), q, ts);
+    }
+
+    TrackerCore::Params params;
+    std::shared_ptr<SharedMap> map;
+    std::shared_ptr<ThreadPool> pool;
+    EventSimulator simulator;
+    uint64_t t;
+};
+
+// tracks the events buffered since the third consistent pose
+TEST_F(AutoStart, StartsFromConsistentPoses) {
+    TrackerCore core(params, map, pool);
+    core.setCalibration(simParams().K, vector<double>(5, 0.0));
+    trackPackets(core, simulator, t, 100);
+    sendPose(core, t - 60000000);
+    sendPose(core, t - 40000000);
+    EXPECT_FALSE(core.isTracking());
+    sendPose(core, t - 20000000);
+    EXPECT_TRUE(core.isTracking());
+    trackPackets(core, simulator, t, 400);
+    EXPECT_TRUE(core.isTracking());
+    EXPECT_LT(positionError(core, simulator, t), 50);
+}
+
+TEST_F(AutoStart, WaitsForConsistentPoses) {
+    TrackerCore core(params, map, pool);
+    core.setCalibration(simParams().K, vector<double>(5, 0.0));
+    trackPackets(core, simulator, t, 100);
+    for (int i = 0; i < 5; ++i) sendPose(core, t - 10000000*(5 - i), i % 2 ? 30 : 0);
+    EXPECT_FALSE(core.isTracking());
+}
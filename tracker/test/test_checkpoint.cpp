@@ -0,0 +1,63 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "sim_util.h"
+
+using namespace track;
+using namespace std;
+
+TEST(Checkpoint, WriteRead) {
+    Checkpoint c;
+    c.X.r = Vec3(1, 2, 3);
+    c.X.q = Quaternion(AngleAxis(0.3, Vec3(1, 1, 0).normalized()));
+    c.X.v = Vec3(-4, 5, 6);
+    c.X.w = AngleAxis(0.7, Vec3::UnitY());
+    c.P = Mat13::Random();
+    c.K = Vec4(120, 90, 200, 201);
+    c.D = vector<double> { -0.1, 0.01, 0, 0, 0.001 };
+    c.last_event_ts = 1234567890123;
+    c.written = 42;
+    string path = testing::TempDir() + "tracker_checkpoint";
+    ASSERT_TRUE(writeCheckpoint(path, c));
+    Checkpoint d;
+    ASSERT_TRUE(readCheckpoint(path, d));
+    EXPECT_EQ(c.X.r, d.X.r);
+    EXPECT_TRUE(c.X.q.isApprox(d.X.q));
+    EXPECT_EQ(c.X.v, d.X.v);
+    EXPECT_NEAR(c.X.w.angle(), d.X.w.angle(), 1e-12);
+    EXPECT_TRUE(c.X.w.axis().isApprox(d.X.w.axis()));
+    EXPECT_EQ(c.P, d.P);
+    EXPECT_EQ(c.K, d.K);
+    EXPECT_EQ(c.D, d.D);
+    EXPECT_EQ(c.last_event_ts, d.last_event_ts);
+    EXPECT_EQ(c.written, d.written);
+    std::remove(path.c_str());
+    EXPECT_FALSE(readCheckpoint(path, d));
+}
+
+// a new core resumes from the checkpoint of another one without a camera pose
+TEST(Checkpoint, ResumesTracking) {
+    EventSimulator::Params sim_params;
+    sim_params.start_time = 1000000000;
+    std::shared_ptr<SharedMap> map = std::make_shared<SharedMap>();
+    std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>(2);
+    EventSimulator simulator(sim_params, *map->getSegments());
+    uint64_t t = sim_params.start_time;
+
+    Checkpoint checkpoint;
+    {
+        TrackerCore core(TrackerCore::Params(), map, pool);
+        startTracking(core, simulator, sim_params.K, t);
+        trackPackets(core, simulator, t, 500);
+        ASSERT_TRUE(core.getCheckpoint(checkpoint));
+    }
+    // restarted 10 ms later
+    t += 10*SIM_PACKET_DURATION;
+    TrackerCore core(TrackerCore::Params(), map, pool);
+    core.restore(checkpoint);
+    EXPECT_TRUE(core.isTracking());
+    trackPackets(core, simulator, t, 500);
+    EXPECT_TRUE(core.isTracking());
+    EXPECT_LT(positionError(core, simulator, t), 50);
+}
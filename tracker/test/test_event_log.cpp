@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+#include <cstdio>
+#include <unistd.h>
+#include "tracker/event_log.h"
+
+using namespace track;
+using namespace std;
+
+namespace
+{
+// 1000 events 1 us apart in chunks of 100
+string writeLog() {
+    string path = testing::TempDir() + "tracker_event_log";
+    EventLogWriter writer(100);
+    EXPECT_TRUE(writer.open(path, 240, 180));
+    for (int i = 0; i < 1000; ++i)
+        writer.add(PackedEvent { uint16_t(i % 240), uint16_t(i % 180), i % 2 == 0, 1000000000ull + i*1000ull });
+    EXPECT_TRUE(writer.close());
+    return path;
+}
+}
+
+TEST(EventLog, Seek) {
+    string path = writeLog();
+    EventLogReader reader;
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(240u, reader.getWidth());
+    EXPECT_EQ(10u, reader.getChunks().size());
+    EXPECT_EQ(1000u, reader.size());
+    reader.seek(1000000000ull + 555500);
+    PackedEvent e;
+    ASSERT_TRUE(reader.next(e));
+    EXPECT_EQ(1000000000ull + 556000, e.t);
+    EXPECT_EQ(556 % 240, e.x);
+    std::remove(path.c_str());
+}
+
+// a recorder killed in the middle of a chunk leaves no index
+TEST(EventLog, RecoversUnclosedLog) {
+    string path = writeLog();
+    EventLogReader reader;
+    ASSERT_TRUE(reader.open(path));
+    const EventLogChunk& last = reader.getChunks().back();
+    off_t truncated = last.offset + last.size/2;
+    reader.close();
+    ASSERT_EQ(0, truncate(path.c_str(), truncated));
+
+    ASSERT_TRUE(reader.open(path));
+    EXPECT_EQ(9u, reader.getChunks().size());
+    uint64_t events = 0;
+    PackedEvent e;
+    while (reader.next(e)) ++events;
+    EXPECT_EQ(900u, events);
+    EXPECT_EQ(1000000000ull + 899000, e.t);
+    std::remove(path.c_str());
+}
@@ -0,0 +1,43 @@
+#include <gtest/gtest.h>
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "sim_util.h"
+
+using namespace track;
+using namespace std;
+
+// idle on a still camera sending noise, tracking again at the first packet of motion
+TEST(IdleMode, FreezesAndResumes) {
+    std::shared_ptr<SharedMap> map = std::make_shared<SharedMap>();
+    TrackerCore::Params params;
+    params.idle_mode = true;
+    TrackerCore core(params, map, std::make_shared<ThreadPool>(2));
+    uint64_t t = 1000000000;
+
+    EventSimulator::Params still_params;
+    still_params.start_time = t;
+    still_params.position_amplitude = Vec3::Zero();
+    still_params.rotation_amplitude = Vec3::Zero();
+    still_params.rate = 5000;
+    still_params.noise_ratio = 1;
+    EventSimulator still(still_params, *map->getSegments());
+    core.setCalibration(still_params.K, vector<double>(5, 0.0));
+    core.setCameraPose(still_params.position, still_params.orientation, t);
+    core.start();
+
+    trackPackets(core, still, t, 100);
+    EXPECT_TRUE(core.isIdle());
+    EXPECT_GT(core.getStats().get(TrackerStats::Idle), 0u);
+    EXPECT_LT((core.getState().r - still_params.position).norm(), 1);
+
+    // moving from the same pose
+    EventSimulator::Params moving_params;
+    moving_params.start_time = t;
+    EventSimulator moving(moving_params, *map->getSegments());
+    trackPackets(core, moving, t, 1);
+    EXPECT_FALSE(core.isIdle());
+    trackPackets(core, moving, t, 300);
+    EXPECT_TRUE(core.isTracking());
+    EXPECT_FALSE(core.isIdle());
+    EXPECT_LT(positionError(core, moving, t), 50);
+}
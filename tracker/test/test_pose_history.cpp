@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <thread>
+#include <atomic>
+#include "tracker/pose_history.h"
+
+using namespace track;
+
+// moving along x at 1000 mm/s, turning around z at 1 rad/s
+static EFK::State stateAt(int64_t ts) {
+    double t = ts*1e-9;
+    EFK::State S;
+    S.r = Vec3(1000*t, 0, 0);
+    S.q = Quaternion(AngleAxis(t, Vec3::UnitZ()));
+    S.v = Vec3(1000, 0, 0);
+    S.w = AngleAxis(1, Vec3::UnitZ());
+    return S;
+}
+
+TEST(PoseHistory, Interpolates) {
+    PoseHistory::Params params;
+    PoseHistory history(params);
+    for (int64_t ts = 0; ts <= 100000000; ts += 1000000) history.add(stateAt(ts), ts);
+    EFK::State S;
+    ASSERT_TRUE(history.get(50500000, S));
+    EXPECT_NEAR(50.5, S.r[0], 1e-9);
+    EXPECT_NEAR(0.0505, S.q.angularDistance(Quaternion::Identity()), 1e-9);
+    EXPECT_NEAR(1, S.w.angle(), 1e-9);
+    ASSERT_TRUE(history.get(0, S));
+    EXPECT_NEAR(0, S.r[0], 1e-9);
+}
+
+TEST(PoseHistory, Extrapolates) {
+    PoseHistory::Params params;
+    PoseHistory history(params);
+    for (int64_t ts = 0; ts <= 100000000; ts += 1000000) history.add(stateAt(ts), ts);
+    EFK::State S;
+    ASSERT_TRUE(history.get(120000000, S));
+    EXPECT_NEAR(120, S.r[0], 1e-9);
+    EXPECT_NEAR(0.12, S.q.angularDistance(Quaternion::Identity()), 1e-9);
+    // beyond max_extrapolation
+    EXPECT_FALSE(history.get(300000000, S));
+}
+
+TEST(PoseHistory, ForgetsOldStates) {
+    PoseHistory::Params params;
+    params.size = 16;
+    PoseHistory history(params);
+    EFK::State S;
+    EXPECT_FALSE(history.get(0, S));
+    for (int64_t ts = 0; ts <= 100000000; ts += 1000000) history.add(stateAt(ts), ts);
+    int64_t begin, end;
+    ASSERT_TRUE(history.getRange(begin, end));
+    EXPECT_EQ(100000000, end);
+    EXPECT_GT(begin, 80000000);
+    EXPECT_FALSE(history.get(50000000, S));
+    // states closer than period are skipped unless forced
+    history.add(stateAt(100500000), 100500000);
+    ASSERT_TRUE(history.getRange(begin, end));
+    EXPECT_EQ(100000000, end);
+    history.add(stateAt(100500000), 100500000, true);
+    ASSERT_TRUE(history.getRange(begin, end));
+    EXPECT_EQ(100500000, end);
+    history.clear();
+    EXPECT_FALSE(history.getRange(begin, end));
+}
+
+// readers never see a torn state while the writer goes round the ring
+TEST(PoseHistory, ConcurrentReaders) {
+    PoseHistory::Params params;
+    params.size = 64;
+    params.period = 0;
+    PoseHistory history(params);
+    const int64_t STEP = 100000, STATES = 200000;
+    std::atomic<bool> done(false);
+    std::atomic<int> errors(0), found(0);
+    std::thread reader([&] {
+        int64_t begin, end;
+        while (!done) {
+            if (!history.getRange(begin, end)) continue;
+            int64_t ts = end - (end - begin)/3;
+            EFK::State S;
+            if (!history.get(ts, S)) continue;
+            ++found;
+            if (std::abs(S.r[0] - ts*1e-6) > 1e-6) ++errors;
+        }
+    });
+    for (int64_t i = 0; i < STATES; ++i) history.add(stateAt(i*STEP), i*STEP);
+    done = true;
+    reader.join();
+    EXPECT_EQ(0, errors);
+    EXPECT_GT(found, 0);
+}
@@ -0,0 +1,76 @@
+#include <gtest/gtest.h>
+#include "tracker/fixed_lag_smoother.h"
+#include "tracker/tracker_core.h"
+#include "tracker/event_simulator.h"
+#include "sim_util.h"
+#include <algorithm>
+
+using namespace track;
+using namespace std;
+
+// events on the segments of the default map seen from the constant
+// velocity motion of X from ts0, n per segment every 1 ms up to ts
+static vector<FixedLagSmoother::Measurement> observe(const EFK::State& X, int64_t ts0, int64_t ts,
+                                                     const Vec4& K) {
+    SharedMap map;
+    vector<FixedLagSmoother::Measurement> measurements;
+    for (int64_t t = ts0 + 1000000; t <= ts; t += 1000000) {
+        EFK::State Xi = FixedLagSmoother::move(X, (t - ts0)*1e-9);
+        for (SlamLine sl : *map.getSegments()) {
+            sl.project(Xi.r, Xi.q, K);
+            for (double a = 0.1; a < 1; a += 0.2)
+                measurements.push_back(FixedLagSmoother::Measurement {
+                    sl.p1_2d + a*(sl.p2_2d - sl.p1_2d), t, sl.p1_3d, sl.p2_3d });
+        }
+    }
+    return measurements;
+}
+
+// the motion of the window is recovered from a wrong start with a weak prior
+TEST(FixedLagSmoother, RecoversWindowMotion) {
+    const Vec4 K(120, 90, 200, 200);
+    EFK::State X;
+    X.r = Vec3(10, -5, -300);
+    X.q = Quaternion(AngleAxis(0.1, Vec3(1, 2, 3).normalized()));
+    X.v = Vec3(50, -20, 30);
+    X.w = AngleAxis(0.3, Vec3(-1, 1, 2).normalized());
+    const int64_t ts0 = 1000000000, ts = ts0 + 100000000;
+    vector<FixedLagSmoother::Measurement> measurements = observe(X, ts0, ts, K);
+
+    EFK::State S0 = X;
+    S0.r += Vec3(3, -2, 4);
+    S0.q = S0.q*Quaternion(AngleAxis(0.02, Vec3::UnitY()));
+    S0.v += Vec3(-10, 10, 0);
+    FixedLagSmoother::Mat12 information = FixedLagSmoother::Mat12::Identity()*1e-6;
+    FixedLagSmoother::Params params;
+    params.iterations = 10;
+    EFK::State S;
+    ASSERT_TRUE(FixedLagSmoother::solve(params, K, 1, S0, information, ts0, measurements, ts, S));
+    EFK::State expected = FixedLagSmoother::move(X, (ts - ts0)*1e-9);
+    EXPECT_LT((S.r - expected.r).norm(), 0.1);
+    EXPECT_LT(S.q.angularDistance(expected.q), 1e-3);
+    EXPECT_LT((S.v - expected.v).norm(), 1);
+}
+
+// the corrections of the solves in the pool keep the filter on the camera,
+// the accuracy is compared with tracker_sim --smoothing 0/1
+TEST(FixedLagSmoother, TracksWithPool) {
+    EventSimulator::Params sim_params;
+    sim_params.start_time = 1000000000;
+    std::shared_ptr<SharedMap> map = std::make_shared<SharedMap>();
+    EventSimulator simulator(sim_params, *map->getSegments());
+    TrackerCore::Params params;
+    params.smoothing = true;
+    TrackerCore core(params, map, std::make_shared<ThreadPool>(2));
+    uint64_t t = sim_params.start_time;
+    startTracking(core, simulator, sim_params.K, t);
+    bool tracking = true;
+    double max_error = 0;
+    for (int i = 0; i < 1000; ++i) {
+        trackPackets(core, simulator, t, 1);
+        tracking = tracking and core.isTracking();
+        max_error = std::max(max_error, positionError(core, simulator, t));
+    }
+    EXPECT_TRUE(tracking);
+    EXPECT_LT(max_error, 25); // 40 mm without smoothing
+}